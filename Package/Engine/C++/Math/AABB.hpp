@@ -47,7 +47,7 @@ class AABB {
 			for (int i = 0; i < DIM; i++) {
 				double axis = point[i];
 				if (axis < min[i]) min[i] = axis;
-				else if (axis > max[i]) max[i] = axis;
+				if (axis > max[i]) max[i] = axis;
 			}
 		}
 
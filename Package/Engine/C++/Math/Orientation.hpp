@@ -39,7 +39,7 @@ API class Orientation {
 				double mag = complex.imag.mag();
 				double phi = std::atan2(mag, complex.real);
 				rotation = 2.0 * phi * complex.imag;
-				if (mag > EPSILON) rotation /= mag;
+				if (mag > 0.0) rotation /= mag;
 #else
 				rotation = normalizeAngle(rotation + other.rotation);
 #endif
@@ -93,7 +93,7 @@ API class Orientation {
 		API void setRotation(const Rotation& _rotation) {
 			rotation = _rotation;
 			double mag = rotation.mag();
-			if (mag > EPSILON) {
+			if (mag > 0.0) {
 				Vector axis = rotation / mag;
 				double phi = mag * 0.5;
 				complex = { std::cos(phi), axis * std::sin(phi) };
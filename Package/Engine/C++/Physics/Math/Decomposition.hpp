@@ -0,0 +1,199 @@
+#pragma once
+
+#include <vector>
+#include <cinttypes>
+#include <unordered_map>
+
+#include "../../Math/Vector.hpp"
+
+#if !IS_3D
+class Decomposition {
+	private:
+		using Piece = std::vector<int>;
+
+		static double signedArea(const std::vector<Vector>& vertices) {
+			double area = 0.0;
+			for (int i = 0; i < vertices.size(); i++)
+				area += cross(vertices[i], vertices[(i + 1) % vertices.size()]);
+			return area * 0.5;
+		}
+
+		static double turn(const Vector& a, const Vector& b, const Vector& c) {
+			return cross(b - a, c - b);
+		}
+
+		static bool inTriangle(const Vector& p, const Vector& a, const Vector& b, const Vector& c) {
+			return turn(a, b, p) >= 0.0 && turn(b, c, p) >= 0.0 && turn(c, a, p) >= 0.0;
+		}
+
+		static std::vector<Vector> clean(const std::vector<Vector>& input) {
+			std::vector<Vector> vertices;
+			for (const Vector& vertex : input)
+				if (vertices.empty() || !(vertices.back() == vertex))
+					vertices.push_back(vertex);
+			while (vertices.size() > 1 && vertices.front() == vertices.back())
+				vertices.pop_back();
+
+			if (signedArea(vertices) < 0.0)
+				std::reverse(vertices.begin(), vertices.end());
+
+			// drop collinear vertices, which would otherwise produce degenerate ears
+			for (int i = 0; i < vertices.size() && vertices.size() > 3;) {
+				const Vector& prev = vertices[(i - 1 + vertices.size()) % vertices.size()];
+				const Vector& next = vertices[(i + 1) % vertices.size()];
+				if (std::abs(turn(prev, vertices[i], next)) < EPSILON * (next - prev).mag())
+					vertices.erase(vertices.begin() + i);
+				else i++;
+			}
+
+			return vertices;
+		}
+
+		static std::vector<Piece> triangulate(const std::vector<Vector>& vertices) {
+			std::vector<Piece> triangles;
+			std::vector<int> remaining = indices(vertices.size());
+
+			while (remaining.size() > 3) {
+				int count = remaining.size();
+				bool clipped = false;
+
+				for (int i = 0; i < count && !clipped; i++) {
+					int prev = remaining[(i - 1 + count) % count];
+					int cur = remaining[i];
+					int next = remaining[(i + 1) % count];
+					const Vector& a = vertices[prev];
+					const Vector& b = vertices[cur];
+					const Vector& c = vertices[next];
+
+					if (turn(a, b, c) <= 0.0) continue;
+
+					bool ear = true;
+					for (int other : remaining) {
+						if (other == prev || other == cur || other == next) continue;
+						if (inTriangle(vertices[other], a, b, c)) {
+							ear = false;
+							break;
+						}
+					}
+
+					if (ear) {
+						triangles.push_back({ prev, cur, next });
+						remaining.erase(remaining.begin() + i);
+						clipped = true;
+					}
+				}
+
+				// no ear exists for self-intersecting input, so fan out what's left
+				if (!clipped) {
+					for (int i = 1; i < remaining.size() - 1; i++)
+						triangles.push_back({ remaining[0], remaining[i], remaining[i + 1] });
+					return triangles;
+				}
+			}
+
+			triangles.push_back(remaining);
+			return triangles;
+		}
+
+	public:
+		// splits a simple polygon into convex pieces using Hertel-Mehlhorn:
+		// an ear-clipped triangulation whose diagonals are removed whenever the merged piece stays convex.
+		// the result has at most four times the minimum number of pieces, and each piece is wound like Polytope expects
+		static std::vector<std::vector<Vector>> convex(const std::vector<Vector>& input) {
+			std::vector<Vector> vertices = clean(input);
+			if (vertices.size() < 3) return { };
+
+			int n = vertices.size();
+			auto edgeKey = [=](int a, int b) {
+				return (int64_t)a * n + b;
+			};
+
+			std::vector<Piece> pieces = triangulate(vertices);
+			std::vector<bool> alive (pieces.size(), true);
+			std::unordered_map<int64_t, int> edgePieces;
+			auto addEdges = [&](int piece) {
+				const Piece& cycle = pieces[piece];
+				for (int i = 0; i < cycle.size(); i++)
+					edgePieces[edgeKey(cycle[i], cycle[(i + 1) % cycle.size()])] = piece;
+			};
+
+			for (int i = 0; i < pieces.size(); i++)
+				addEdges(i);
+
+			auto position = [](const Piece& cycle, int vertex) {
+				return (int)(std::find(cycle.begin(), cycle.end(), vertex) - cycle.begin());
+			};
+
+			// repeatedly remove the longest diagonal that leaves a convex piece
+			while (true) {
+				int bestPiece = -1, bestEdge = -1;
+				double bestLength = 0.0;
+
+				for (int p = 0; p < pieces.size(); p++) {
+					if (!alive[p]) continue;
+
+					const Piece& P = pieces[p];
+					for (int i = 0; i < P.size(); i++) {
+						int a = P[i];
+						int b = P[(i + 1) % P.size()];
+						if (a > b || !edgePieces.count(edgeKey(b, a))) continue;
+
+						const Piece& Q = pieces[edgePieces.at(edgeKey(b, a))];
+						int qa = position(Q, a);
+						int qb = position(Q, b);
+
+						// the merged piece must stay convex at both ends of the diagonal
+						const Vector& beforeA = vertices[P[(i - 1 + P.size()) % P.size()]];
+						const Vector& afterA = vertices[Q[(qa + 1) % Q.size()]];
+						const Vector& beforeB = vertices[Q[(qb - 1 + Q.size()) % Q.size()]];
+						const Vector& afterB = vertices[P[(i + 2) % P.size()]];
+						if (turn(beforeA, vertices[a], afterA) < 0.0) continue;
+						if (turn(beforeB, vertices[b], afterB) < 0.0) continue;
+
+						double length = (vertices[b] - vertices[a]).sqrMag();
+						if (length > bestLength) {
+							bestLength = length;
+							bestPiece = p;
+							bestEdge = i;
+						}
+					}
+				}
+
+				if (bestPiece < 0) break;
+
+				const Piece& P = pieces[bestPiece];
+				int a = P[bestEdge];
+				int b = P[(bestEdge + 1) % P.size()];
+				int q = edgePieces.at(edgeKey(b, a));
+				const Piece& Q = pieces[q];
+				int qa = position(Q, a);
+
+				// walk P from b around to a, then Q from after a up to before b
+				Piece cycle;
+				for (int k = 0; k < P.size(); k++)
+					cycle.push_back(P[(bestEdge + 1 + k) % P.size()]);
+				for (int k = 1; k < Q.size() - 1; k++)
+					cycle.push_back(Q[(qa + k) % Q.size()]);
+
+				for (const Piece* old : { &P, &Q })
+					for (int k = 0; k < old->size(); k++)
+						edgePieces.erase(edgeKey((*old)[k], (*old)[(k + 1) % old->size()]));
+
+				alive[q] = false;
+				pieces[bestPiece] = cycle;
+				addEdges(bestPiece);
+			}
+
+			std::vector<std::vector<Vector>> result;
+			for (int p = 0; p < pieces.size(); p++) {
+				if (!alive[p]) continue;
+				std::vector<Vector> piece;
+				for (int index : pieces[p])
+					piece.push_back(vertices[index]);
+				result.push_back(piece);
+			}
+
+			return result;
+		}
+};
+#endif
@@ -0,0 +1,389 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cinttypes>
+#include <unordered_map>
+
+#include "../../Math/AABB.hpp"
+#include "../../Math/Coord.hpp"
+
+class Hull {
+	private:
+		static constexpr double RELATIVE_TOLERANCE = 1e-4;
+
+		static double getTolerance(const std::vector<Vector>& points) {
+			AABB bounds;
+			for (const Vector& point : points)
+				bounds.add(point);
+			return std::max(EPSILON, (bounds.max - bounds.min).mag() * RELATIVE_TOLERANCE);
+		}
+
+		static std::vector<Vector> weld(const std::vector<Vector>& points, double tolerance) {
+			std::unordered_map<Coord, std::vector<int>> cells;
+			std::vector<Vector> result;
+
+			for (const Vector& point : points) {
+				Coord cell (point / tolerance);
+				Coord min, max;
+				for (int i = 0; i < DIM; i++) {
+					min[i] = cell[i] - 1;
+					max[i] = cell[i] + 1;
+				}
+
+				bool duplicate = false;
+				ND_LOOP(neighbor, min, max) {
+					auto found = cells.find(neighbor);
+					if (found == cells.end()) continue;
+					for (int index : found->second)
+						if ((result[index] - point).sqrMag() <= tolerance * tolerance)
+							duplicate = true;
+				}
+
+				if (!duplicate) {
+					cells[cell].push_back(result.size());
+					result.push_back(point);
+				}
+			}
+
+			return result;
+		}
+
+#if IS_3D
+		class HullFace {
+			public:
+				std::array<int, 3> indices;
+				Vector normal;
+				double distance;
+				std::vector<int> outside;
+				int farthest = -1;
+				double farthestDistance = 0.0;
+				bool alive = true;
+
+				HullFace(const std::vector<Vector>& points, int a, int b, int c) {
+					indices = { a, b, c };
+					normal = cross(points[b] - points[a], points[c] - points[a]).normalize();
+					distance = dot(normal, points[a]);
+				}
+
+				double signedDistance(const Vector& point) const {
+					return dot(normal, point) - distance;
+				}
+		};
+
+		static bool assign(std::vector<HullFace>& faces, int first, const std::vector<Vector>& points, int index, double tolerance) {
+			for (int i = first; i < faces.size(); i++) {
+				HullFace& face = faces[i];
+				double dist = face.signedDistance(points[index]);
+				if (face.alive && dist > tolerance) {
+					face.outside.push_back(index);
+					if (dist > face.farthestDistance) {
+						face.farthest = index;
+						face.farthestDistance = dist;
+					}
+					return true;
+				}
+			}
+			return false;
+		}
+
+		static bool initialSimplex(const std::vector<Vector>& points, double tolerance, std::array<int, 4>& simplex) {
+			// the most distant pair of axis extremes
+			std::vector<int> extremes;
+			for (int axis = 0; axis < 3; axis++) {
+				int min = 0, max = 0;
+				for (int i = 1; i < points.size(); i++) {
+					if (points[i][axis] < points[min][axis]) min = i;
+					if (points[i][axis] > points[max][axis]) max = i;
+				}
+				extremes.push_back(min);
+				extremes.push_back(max);
+			}
+
+			double best = -1;
+			for (int a : extremes)
+			for (int b : extremes) {
+				double dist = (points[a] - points[b]).sqrMag();
+				if (dist > best) {
+					best = dist;
+					simplex[0] = a;
+					simplex[1] = b;
+				}
+			}
+
+			Vector a = points[simplex[0]];
+			Vector axis = (points[simplex[1]] - a).normalized();
+			best = tolerance;
+			simplex[2] = -1;
+			for (int i = 0; i < points.size(); i++) {
+				double dist = cross(points[i] - a, axis).mag();
+				if (dist > best) {
+					best = dist;
+					simplex[2] = i;
+				}
+			}
+			if (simplex[2] < 0) return false;
+
+			Vector normal = cross(points[simplex[1]] - a, points[simplex[2]] - a).normalize();
+			best = tolerance;
+			simplex[3] = -1;
+			for (int i = 0; i < points.size(); i++) {
+				double dist = std::abs(dot(points[i] - a, normal));
+				if (dist > best) {
+					best = dist;
+					simplex[3] = i;
+				}
+			}
+			return simplex[3] >= 0;
+		}
+#else
+		static Vector outward(const Vector& start, const Vector& end) {
+			return -(end - start).normal().normalize();
+		}
+#endif
+
+	public:
+		std::vector<Vector> vertices;
+#if IS_3D
+		std::vector<std::array<int, 3>> faces;
+#endif
+
+		bool empty() const {
+			return vertices.size() <= DIM;
+		}
+
+		// builds the convex hull of a point cloud using quickhull.
+		// nearby points are welded, points within tolerance of a face are treated as coplanar,
+		// and at most maxVertices vertices are kept (farthest first) when maxVertices > 0
+		static Hull build(const std::vector<Vector>& input, int maxVertices = 0) {
+			Hull result;
+			if (input.size() <= DIM) return result;
+
+			double tolerance = getTolerance(input);
+			std::vector<Vector> points = weld(input, tolerance);
+			if (points.size() <= DIM) return result;
+
+			if (maxVertices > 0) maxVertices = std::max(maxVertices, DIM + 1);
+
+#if IS_3D
+			std::array<int, 4> simplex;
+			if (!initialSimplex(points, tolerance, simplex)) return result;
+
+			std::vector<HullFace> faces;
+			Vector center = average(std::array<Vector, 4> {
+				points[simplex[0]], points[simplex[1]],
+				points[simplex[2]], points[simplex[3]]
+			});
+
+			for (auto [a, b, c] : std::array<std::array<int, 3>, 4> {{ { 0, 1, 2 }, { 0, 3, 1 }, { 1, 3, 2 }, { 2, 3, 0 } }}) {
+				HullFace face (points, simplex[a], simplex[b], simplex[c]);
+				if (face.signedDistance(center) > 0.0)
+					face = HullFace(points, simplex[a], simplex[c], simplex[b]);
+				faces.push_back(face);
+			}
+
+			for (int i = 0; i < points.size(); i++)
+				if (std::find(simplex.begin(), simplex.end(), i) == simplex.end())
+					assign(faces, 0, points, i, tolerance);
+
+			auto edgeKey = [&](int a, int b) {
+				return (int64_t)a * points.size() + b;
+			};
+
+			std::unordered_map<int64_t, int> edgeFaces;
+			auto addEdges = [&](int face) {
+				const auto& idx = faces[face].indices;
+				for (int k = 0; k < 3; k++)
+					edgeFaces[edgeKey(idx[k], idx[(k + 1) % 3])] = face;
+			};
+
+			std::vector<int> aliveFaces = indices(faces.size());
+			for (int face : aliveFaces)
+				addEdges(face);
+
+			int vertexCount = 4;
+			while (maxVertices <= 0 || vertexCount < maxVertices) {
+				// expand toward the farthest outside point first
+				int eyeFace = -1, eye = -1;
+				double farthest = tolerance;
+				for (int face : aliveFaces) {
+					if (faces[face].farthest >= 0 && faces[face].farthestDistance > farthest) {
+						farthest = faces[face].farthestDistance;
+						eyeFace = face;
+						eye = faces[face].farthest;
+					}
+				}
+
+				if (eye < 0) break;
+
+				const Vector& eyePoint = points[eye];
+
+				// flood the visible region, absorbing coplanar neighbors so they merge into the new fan
+				std::vector<bool> isVisible (faces.size(), false);
+				std::vector<int> visible, stack { eyeFace };
+				isVisible[eyeFace] = true;
+				while (!stack.empty()) {
+					int f = stack.back();
+					stack.pop_back();
+					visible.push_back(f);
+					const auto& idx = faces[f].indices;
+					for (int k = 0; k < 3; k++) {
+						int twin = edgeFaces.at(edgeKey(idx[(k + 1) % 3], idx[k]));
+						if (!isVisible[twin] && faces[twin].signedDistance(eyePoint) > -tolerance) {
+							isVisible[twin] = true;
+							stack.push_back(twin);
+						}
+					}
+				}
+
+				std::vector<std::pair<int, int>> horizon;
+				std::vector<int> orphans;
+				for (int f : visible) {
+					const auto& idx = faces[f].indices;
+					for (int k = 0; k < 3; k++) {
+						int a = idx[k], b = idx[(k + 1) % 3];
+						if (!isVisible[edgeFaces.at(edgeKey(b, a))])
+							horizon.emplace_back(a, b);
+					}
+					faces[f].alive = false;
+					orphans.insert(orphans.end(), faces[f].outside.begin(), faces[f].outside.end());
+					faces[f].outside.clear();
+				}
+
+				for (int f : visible) {
+					const auto& idx = faces[f].indices;
+					for (int k = 0; k < 3; k++)
+						edgeFaces.erase(edgeKey(idx[k], idx[(k + 1) % 3]));
+				}
+
+				int first = faces.size();
+				for (auto [a, b] : horizon) {
+					faces.emplace_back(points, a, b, eye);
+					addEdges(faces.size() - 1);
+				}
+				vertexCount++;
+
+				std::erase_if(aliveFaces, [&](int face) { return !faces[face].alive; });
+				for (int face = first; face < faces.size(); face++)
+					aliveFaces.push_back(face);
+
+				for (int index : orphans)
+					if (index != eye)
+						assign(faces, first, points, index, tolerance);
+			}
+
+			// compact the vertices. outward winding here is inward for Triangle::normal, as Polytope expects
+			std::vector<int> remap (points.size(), -1);
+			for (const HullFace& face : faces) {
+				if (!face.alive) continue;
+				std::array<int, 3> indices;
+				for (int k = 0; k < 3; k++) {
+					int& mapped = remap[face.indices[k]];
+					if (mapped < 0) {
+						mapped = result.vertices.size();
+						result.vertices.push_back(points[face.indices[k]]);
+					}
+					indices[k] = mapped;
+				}
+				result.faces.push_back(indices);
+			}
+#else
+			// initial segment between the extremes along x, as a degenerate two-edge ring
+			int min = 0, max = 0;
+			for (int i = 1; i < points.size(); i++) {
+				if (points[i][0] < points[min][0]) min = i;
+				if (points[i][0] > points[max][0]) max = i;
+			}
+			if (min == max) return result;
+
+			std::vector<int> ring { min, max };
+			std::vector<std::vector<int>> outside (2);
+
+			auto distanceTo = [&](int edge, const Vector& point) {
+				const Vector& start = points[ring[edge]];
+				const Vector& end = points[ring[(edge + 1) % ring.size()]];
+				return dot(outward(start, end), point - start);
+			};
+
+			for (int i = 0; i < points.size(); i++) {
+				if (i == min || i == max) continue;
+				for (int edge = 0; edge < 2; edge++) {
+					if (distanceTo(edge, points[i]) > tolerance) {
+						outside[edge].push_back(i);
+						break;
+					}
+				}
+			}
+
+			while (maxVertices <= 0 || ring.size() < maxVertices) {
+				int eyeEdge = -1, eye = -1;
+				double farthest = tolerance;
+				for (int edge = 0; edge < ring.size(); edge++) {
+					for (int index : outside[edge]) {
+						double dist = distanceTo(edge, points[index]);
+						if (dist > farthest) {
+							farthest = dist;
+							eyeEdge = edge;
+							eye = index;
+						}
+					}
+				}
+
+				if (eye < 0) break;
+
+				// extend the visible chain of edges in both directions
+				int count = ring.size();
+				int first = eyeEdge, last = eyeEdge;
+				while (last - first + 1 < count && distanceTo((first - 1 + count) % count, points[eye]) > -tolerance)
+					first--;
+				while (last - first + 1 < count && distanceTo((last + 1) % count, points[eye]) > -tolerance)
+					last++;
+
+				std::vector<int> orphans;
+				for (int edge = first; edge <= last; edge++) {
+					const auto& list = outside[(edge + count) % count];
+					orphans.insert(orphans.end(), list.begin(), list.end());
+				}
+
+				// rebuild the ring starting after the visible chain, so the chain's vertices drop out
+				std::vector<int> nextRing;
+				std::vector<std::vector<int>> nextOutside;
+				for (int i = last + 1; i <= first + count; i++)
+					nextRing.push_back(ring[i % count]);
+				for (int i = last + 1; i < first + count; i++)
+					nextOutside.push_back(outside[i % count]);
+				nextRing.push_back(eye);
+				nextOutside.emplace_back();
+				nextOutside.emplace_back();
+
+				ring = nextRing;
+				outside = nextOutside;
+
+				int newEdges[] { (int)ring.size() - 2, (int)ring.size() - 1 };
+				for (int index : orphans) {
+					if (index == eye) continue;
+					for (int edge : newEdges) {
+						if (distanceTo(edge, points[index]) > tolerance) {
+							outside[edge].push_back(index);
+							break;
+						}
+					}
+				}
+			}
+
+			// merge collinear edges
+			for (int i = 0; i < ring.size() && ring.size() > 3;) {
+				const Vector& prev = points[ring[(i - 1 + ring.size()) % ring.size()]];
+				const Vector& next = points[ring[(i + 1) % ring.size()]];
+				if (dot(outward(prev, next), points[ring[i]] - prev) <= tolerance)
+					ring.erase(ring.begin() + i);
+				else i++;
+			}
+
+			for (int index : ring)
+				result.vertices.push_back(points[index]);
+#endif
+
+			return result;
+		}
+};
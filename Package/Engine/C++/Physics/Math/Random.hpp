@@ -24,6 +24,11 @@ class Random {
 			seed = _seed;
 		}
 
+		// an independent generator, seeded from this one
+		Random split() {
+			return Random(next(UINT64_MAX));
+		}
+
 		template <typename T>
 		void shuffle(std::vector<T>& arr) {
 			for (int i = 0; i < arr.size(); i++)
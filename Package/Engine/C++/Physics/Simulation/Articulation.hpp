@@ -0,0 +1,603 @@
+#pragma once
+
+#include <vector>
+
+#include "RigidBody.hpp"
+
+// a tree of bodies joined at pivots, simulated in joint coordinates instead of being held together by
+// constraints, so the joints can't come apart. links are stored parent first, and every substep runs
+// Featherstone's articulated body algorithm over them, which takes time linear in the number of links.
+// contacts and constraints still act on each link as a free body. whatever they changed is then carried
+// through the tree as an impulse on those links, so the whole articulation answers with its combined mass
+API class Articulation {
+	private:
+		static constexpr int SPATIAL = IF_3D(6, 3);
+		static constexpr int FREEDOM = IF_3D(3, 1);
+		static constexpr double MAX_TURN = 0.25;
+		// the gyroscopic torque is found again from the spin it leads to, so the first pass's guess is refined once
+		static constexpr int GYROSCOPIC_PASSES = 2;
+
+		// angular part first, with the linear part taken at the link's center of mass, in world axes
+		using Spatial = VectorN<SPATIAL>;
+		using SpatialInertia = MatrixRC<SPATIAL>;
+		using Rates = VectorN<FREEDOM>;
+		using Subspace = MatrixRC<SPATIAL, FREEDOM>;
+
+		enum Joint { PIVOT, HINGE };
+
+		// the tree, with each joint's anchor in its parent's and its own space.
+		// a link's orientation is its parent's turned by the joint's turn
+		std::vector<RigidBody*> links;
+		std::vector<int> parents;
+		std::vector<Joint> joints;
+		std::vector<Vector> parentAnchors, childAnchors, axes;
+		std::vector<Orientation> turns;
+		// how fast each joint turns, about its axis for hinges and in world axes otherwise
+		std::vector<Rates> rates;
+
+		// where the links were last placed and how fast they were moving,
+		// so anything else that moves them can be told apart
+		std::vector<Transform> poses;
+		std::vector<Spatial> motions;
+
+		// articulated body algorithm, per link
+		std::vector<Vector> levers, arms;
+		std::vector<Subspace> subspaces, transfers;
+		std::vector<MatrixRC<FREEDOM>> invResponses;
+		std::vector<Rates> drives, changes;
+		std::vector<Spatial> biases, forces, accelerations;
+		std::vector<SpatialInertia> inertias, articulated;
+		SpatialInertia invRoot = SpatialInertia(0.0);
+
+		// what the links weigh in the articulation, while contacts are solved
+		std::vector<Matter> lent;
+		bool lending = false;
+		// what each link's motion is to be changed to
+		std::vector<Spatial> targets;
+
+		static Spatial join(const Rotation& angular, const Vector& linear) {
+			Spatial result;
+#if IS_3D
+			for (int i = 0; i < 3; i++) {
+				result[i] = angular[i];
+				result[i + 3] = linear[i];
+			}
+#else
+			result[0] = angular;
+			result[1] = linear[0];
+			result[2] = linear[1];
+#endif
+			return result;
+		}
+
+		static Rotation getAngular(const Spatial& value) {
+			return IF_3D(Vector(value[0], value[1], value[2]), value[0]);
+		}
+
+		static Vector getLinear(const Spatial& value) {
+			return IF_3D(Vector(value[3], value[4], value[5]), Vector(value[1], value[2]));
+		}
+
+		// the turn and move from one placement to another, in world axes
+		static Spatial getChange(const Transform& from, const Transform& to) {
+			return join((to.orientation * -from.orientation).getRotation(), to.linear - from.linear);
+		}
+
+		static Vector getPointVelocity(const Rotation& angular, const Vector& offset) {
+			return IF_3D(cross(angular, offset), offset.normal() * angular);
+		}
+
+		// the same motion, seen from a point offset from the one it was taken at
+		static Spatial shiftMotion(const Spatial& motion, const Vector& offset) {
+			Rotation angular = getAngular(motion);
+			return join(angular, getLinear(motion) + getPointVelocity(angular, offset));
+		}
+
+		// shiftMotion as a matrix. its transpose moves forces back the other way
+		static SpatialInertia getShift(const Vector& offset) {
+			SpatialInertia result;
+			for (int c = 0; c < SPATIAL; c++) {
+				Spatial unit;
+				unit[c] = 1.0;
+				Spatial column = shiftMotion(unit, offset);
+				for (int r = 0; r < SPATIAL; r++)
+					result[r][c] = column[r];
+			}
+			return result;
+		}
+
+		// turned the way the link was last placed, where its subspace was taken, rather than wherever its body is now
+		SpatialInertia getInertia(int index) const {
+			const RigidBody& link = *links[index];
+			SpatialInertia result (0.0);
+			if (!link.getDynamic()) return result;
+
+			Matter matter = link.principalMatter.rotate(poses[index].orientation);
+#if IS_3D
+			for (int r = 0; r < 3; r++) {
+				for (int c = 0; c < 3; c++)
+					result[r][c] = matter.inertia[r][c];
+				result[r + 3][r + 3] = matter.mass;
+			}
+#else
+			result[0][0] = matter.inertia;
+			result[1][1] = result[2][2] = matter.mass;
+#endif
+			return result;
+		}
+
+		// the motions the joint allows, one column per freedom, at the link's center
+		Subspace getSubspace(int index) const {
+			Subspace result (0.0);
+			auto setColumn = [&](int column, const Rotation& axis) {
+				Spatial motion = join(axis, getPointVelocity(axis, arms[index]));
+				for (int r = 0; r < SPATIAL; r++)
+					result[r][column] = motion[r];
+			};
+
+#if IS_3D
+			if (joints[index] == HINGE) {
+				setColumn(0, poses[parents[index]].orientation * axes[index]);
+			} else {
+				for (int i = 0; i < 3; i++) {
+					Vector axis;
+					axis[i] = 1.0;
+					setColumn(i, axis);
+				}
+			}
+#else
+			setColumn(0, 1.0);
+#endif
+			return result;
+		}
+
+		// the part of the link's acceleration that comes from velocities alone
+		Spatial getBias(int index) const {
+			Rotation parentSpin = getAngular(motions[parents[index]]);
+			Rotation spin = getAngular(motions[index]);
+			// a hinge's axis turns with its parent, while a pivot's rates are kept in world axes
+			Rotation turning = IF_3D(joints[index] == HINGE ? cross(parentSpin, getAngular(subspaces[index] * rates[index])) : Vector(), 0.0);
+
+			return join(turning,
+				getPointVelocity(turning, arms[index]) +
+				getPointVelocity(parentSpin, getPointVelocity(parentSpin, levers[index])) +
+				getPointVelocity(spin, getPointVelocity(spin, arms[index]))
+			);
+		}
+
+		bool getFree() const {
+			return links[0]->getDynamic();
+		}
+
+		// places every link after the root from the joints, and works out what the algorithm needs to know about each
+		void forward() {
+			for (int i = 1; i < links.size(); i++) {
+				const Transform& parent = poses[parents[i]];
+				Orientation orientation = parent.orientation * turns[i];
+				Vector pivot = parent * parentAnchors[i];
+				poses[i] = Transform(pivot - orientation * childAnchors[i], orientation);
+
+				levers[i] = pivot - parent.linear;
+				arms[i] = poses[i].linear - pivot;
+				subspaces[i] = getSubspace(i);
+				motions[i] = shiftMotion(motions[parents[i]], levers[i] + arms[i]) + subspaces[i] * rates[i];
+			}
+		}
+
+		// moving the links counts as their motion for the substep, placing them doesn't
+		void writePositions(bool moved) {
+			for (int i = 0; i < links.size(); i++) {
+				RigidBody& link = *links[i];
+				if (!link.getDynamic()) continue;
+
+				if (moved) link.moveTo(poses[i]);
+				else {
+					link.position = poses[i];
+					link.syncWithPosition();
+				}
+				if (lending) link.lendMatter(lent[i]);
+			}
+		}
+
+		void writeVelocities() {
+			for (int i = 0; i < links.size(); i++)
+				if (links[i]->getDynamic())
+					links[i]->velocity = Transform(getLinear(motions[i]), Orientation(getAngular(motions[i])));
+		}
+
+		// the articulated inertias, gathered from the leaves in. they don't depend on the forces,
+		// so one pass here can answer any number of them
+		void factor() {
+			for (int i = links.size() - 1; i > 0; i--) {
+				const Subspace& subspace = subspaces[i];
+				transfers[i] = inertias[i] * subspace;
+
+				// freedoms a hinge doesn't have are left out, by answering to them on their own
+				MatrixRC<FREEDOM> response = subspace.transpose() * transfers[i];
+				if (joints[i] == HINGE)
+					for (int k = 1; k < FREEDOM; k++)
+						response[k][k] = 1.0;
+				std::optional<MatrixRC<FREEDOM>> invResponse = response.inverse();
+				invResponses[i] = invResponse ? *invResponse : MatrixRC<FREEDOM>(0.0);
+
+				articulated[i] = inertias[i] - transfers[i] * invResponses[i] * transfers[i].transpose();
+				SpatialInertia shift = getShift(levers[i] + arms[i]);
+				inertias[parents[i]] += shift.transpose() * articulated[i] * shift;
+			}
+
+			std::optional<SpatialInertia> invInertia = getFree() ? inertias[0].inverse() : std::nullopt;
+			invRoot = invInertia ? *invInertia : SpatialInertia(0.0);
+		}
+
+		// forces are gathered from the leaves in, then accelerations are handed out from the root.
+		// the root's acceleration ends up in accelerations[0], and each joint's in changes
+		void propagate() {
+			for (int i = links.size() - 1; i > 0; i--) {
+				drives[i] = -(subspaces[i].transpose() * forces[i]);
+				Spatial force = forces[i] + articulated[i] * biases[i] + transfers[i] * (invResponses[i] * drives[i]);
+				forces[parents[i]] += getShift(levers[i] + arms[i]).transpose() * force;
+			}
+
+			accelerations[0] = -(invRoot * forces[0]);
+			for (int i = 1; i < links.size(); i++) {
+				Spatial acceleration = shiftMotion(accelerations[parents[i]], levers[i] + arms[i]) + biases[i];
+				changes[i] = invResponses[i] * (drives[i] - transfers[i].transpose() * acceleration);
+				accelerations[i] = acceleration + subspaces[i] * changes[i];
+			}
+		}
+
+		void solve() {
+			factor();
+			propagate();
+		}
+
+		// turns the joint by a small rotation, given in world axes
+		void turn(int index, const Rates& amount) {
+#if IS_3D
+			Vector local = joints[index] == HINGE
+				? axes[index] * amount[0]
+				: -poses[parents[index]].orientation * Vector(amount[0], amount[1], amount[2]);
+			turns[index] = Orientation(local) * turns[index];
+#else
+			turns[index] = Orientation(amount[0]) * turns[index];
+#endif
+		}
+
+		void scale(double factor) {
+			motions[0] *= factor;
+			for (int i = 1; i < links.size(); i++)
+				rates[i] *= factor;
+			forward();
+		}
+
+		// answers the forces, gathered per link, with how the joints and a free root change over dt
+		void respond(double dt) {
+			solve();
+
+			if (getFree()) motions[0] += accelerations[0] * dt;
+			for (int i = 1; i < links.size(); i++)
+				rates[i] += changes[i] * dt;
+			forward();
+		}
+
+		// the impulse each link would need to change its motion by as much as it was given, if it were free
+		void setImpulses() {
+			for (int i = 0; i < links.size(); i++) {
+				inertias[i] = getInertia(i);
+				biases[i] = Spatial();
+				forces[i] = links[i]->getDynamic() ? -(inertias[i] * (targets[i] - motions[i])) : Spatial();
+			}
+		}
+
+		int add(int parent, RigidBody* body, const Vector& anchor, Joint joint, const Vector& axis) {
+			const Transform& parentPosition = links[parent]->position;
+			links.push_back(body);
+			parents.push_back(parent);
+			joints.push_back(joint);
+			parentAnchors.push_back(parentPosition.inverse() * anchor);
+			childAnchors.push_back(body->position.inverse() * anchor);
+			axes.push_back(IF_3D(-parentPosition.orientation * axis, axis));
+			turns.push_back(-parentPosition.orientation * body->position.orientation);
+
+			// it keeps however fast it was already turning relative to its parent
+			Rotation spin = body->velocity.orientation.getRotation() - links[parent]->velocity.orientation.getRotation();
+			Rates& rate = rates.emplace_back();
+#if IS_3D
+			if (joint == HINGE) rate[0] = dot(spin, axis);
+			else rate = Rates(spin[0], spin[1], spin[2]);
+#else
+			rate[0] = spin;
+#endif
+
+			poses.push_back(body->position);
+			motions.emplace_back();
+			levers.emplace_back();
+			arms.emplace_back();
+			subspaces.emplace_back(0.0);
+			transfers.emplace_back(0.0);
+			invResponses.emplace_back(0.0);
+			drives.emplace_back();
+			changes.emplace_back();
+			biases.emplace_back();
+			forces.emplace_back();
+			accelerations.emplace_back();
+			inertias.emplace_back(0.0);
+			articulated.emplace_back(0.0);
+			targets.emplace_back();
+			lent.emplace_back();
+
+			if (body->getDynamic()) body->articulation = this;
+			return links.size() - 1;
+		}
+
+	public:
+		// a fixed root, like a static body, holds the rest up. a dynamic one is free to move with them
+		API Articulation(RigidBody* root) {
+			links.push_back(root);
+			parents.push_back(-1);
+			joints.push_back(PIVOT);
+			parentAnchors.emplace_back();
+			childAnchors.emplace_back();
+			axes.emplace_back();
+			turns.emplace_back();
+			rates.emplace_back();
+
+			poses.push_back(root->position);
+			motions.push_back(join(root->velocity.orientation.getRotation(), root->velocity.linear));
+			levers.emplace_back();
+			arms.emplace_back();
+			subspaces.emplace_back(0.0);
+			transfers.emplace_back(0.0);
+			invResponses.emplace_back(0.0);
+			drives.emplace_back();
+			changes.emplace_back();
+			biases.emplace_back();
+			forces.emplace_back();
+			accelerations.emplace_back();
+			inertias.emplace_back(0.0);
+			articulated.emplace_back(0.0);
+			targets.emplace_back();
+			lent.emplace_back();
+
+			if (root->getDynamic()) root->articulation = this;
+		}
+
+		~Articulation() {
+			for (RigidBody* link : links)
+				if (link->articulation == this) link->articulation = nullptr;
+		}
+
+		// joins the body to the parent link at the anchor, given in world space, leaving it free to turn
+		// any way about it. returns the new link's index
+		API int addLink(int parent, RigidBody* body, const Vector& anchor) {
+			return add(parent, body, anchor, PIVOT, Vector());
+		}
+
+#if IS_3D
+		// the same, but only turning about the axis, given in world space
+		API int addHinge(int parent, RigidBody* body, const Vector& anchor, const Vector& axis) {
+			return add(parent, body, anchor, HINGE, axis.normalized());
+		}
+#endif
+
+		API int getLinkCount() const {
+			return links.size();
+		}
+
+		API RigidBody* getLink(int index) const {
+			return links[index];
+		}
+
+		API int getParent(int index) const {
+			return parents[index];
+		}
+
+		API bool hasLink(RigidBody* body) const {
+			return std::find(links.begin(), links.end(), body) != links.end();
+		}
+
+		const std::vector<RigidBody*>& getLinks() const {
+			return links;
+		}
+
+		// the first link that moves, which stands in for the whole articulation when grouping bodies
+		RigidBody* getLead() const {
+			if (getFree()) return links[0];
+			return links.size() > 1 ? links[1] : nullptr;
+		}
+
+		// at the start of a step the root is wherever its body is now, in case it was moved
+		void sync() {
+			poses[0] = links[0]->position;
+			motions[0] = join(links[0]->velocity.orientation.getRotation(), links[0]->velocity.linear);
+			forward();
+			writePositions(false);
+			writeVelocities();
+		}
+
+		// gravity and the joints' turning kick the joints and a free root, then drag slows them
+		void applyForces(const Vector& gravity, double drag, double dt) {
+			for (int i = 0; i < links.size(); i++) {
+				const RigidBody& link = *links[i];
+				inertias[i] = getInertia(i);
+				biases[i] = i ? getBias(i) : Spatial();
+				forces[i] = Spatial();
+				if (link.getDynamic() && link.gravity)
+					forces[i] = join(Rotation(), -gravity * link.localMatter.mass);
+			}
+			respond(dt);
+
+			if (links[0]->drag) scale(pow(1.0 - drag, dt));
+		}
+
+		// moves the links along for the substep
+		void integrate(double dt) {
+			// the joints' turning is only accounted for at the start of the substep, which goes wrong quickly once
+			// a joint turns much within one. the whole articulation is slowed until none turns further than that,
+			// since slowing joints one at a time would speed up any link that was turning against its parent
+			double fastest = 0.0;
+			for (int i = 1; i < links.size(); i++)
+				fastest = std::max(fastest, rates[i].mag() * dt);
+			if (fastest > MAX_TURN) scale(MAX_TURN / fastest);
+
+			if (getFree()) {
+				poses[0].linear += getLinear(motions[0]) * dt;
+				poses[0].orientation += Orientation(getAngular(motions[0]) * dt);
+			}
+			for (int i = 1; i < links.size(); i++)
+				turn(i, rates[i] * dt);
+			forward();
+
+#if IS_3D
+			// each link's spin precesses under its gyroscopic torque, as the whole articulation answers it. the torque
+			// is taken at the spin halfway through the change, where it is square to the spin and can do no work
+			std::vector<Spatial> before = motions;
+			std::vector<Rates> start = rates;
+			for (int i = 0; i < links.size(); i++) {
+				inertias[i] = getInertia(i);
+				biases[i] = Spatial();
+			}
+			factor();
+			for (int pass = 0; pass < GYROSCOPIC_PASSES; pass++) {
+				for (int i = 0; i < links.size(); i++) {
+					Rotation spin = (getAngular(before[i]) + getAngular(motions[i])) * 0.5;
+					forces[i] = join(cross(spin, getAngular(getInertia(i) * join(spin, Vector()))) * dt, Vector());
+				}
+				propagate();
+
+				if (getFree()) motions[0] = before[0] + accelerations[0];
+				for (int i = 1; i < links.size(); i++)
+					rates[i] = start[i] + changes[i];
+				forward();
+			}
+#endif
+
+			writePositions(true);
+			writeVelocities();
+		}
+
+		// whatever moved the links as free bodies is carried through the tree as the smallest change to the joints
+		// and root that moves them the same way, against their combined mass. with velocities, however far the joints
+		// then put the links from where they were moved to counts as motion over dt, on top of their velocities
+		void absorbPositions(double dt, bool velocities) {
+			bool moved = false;
+			for (int i = 0; i < links.size(); i++) {
+				const RigidBody& link = *links[i];
+				inertias[i] = getInertia(i);
+				biases[i] = Spatial();
+				forces[i] = Spatial();
+				if (!link.getDynamic()) continue;
+				if (link.position.linear == poses[i].linear && link.position.orientation == poses[i].orientation) continue;
+
+				forces[i] = -(inertias[i] * getChange(poses[i], link.position));
+				moved = true;
+			}
+			if (!moved) return;
+			solve();
+
+			if (getFree()) {
+				poses[0].linear += getLinear(accelerations[0]);
+				poses[0].orientation += Orientation(getAngular(accelerations[0]));
+			}
+			for (int i = 1; i < links.size(); i++)
+				turn(i, changes[i]);
+			forward();
+
+			if (velocities) {
+				for (int i = 0; i < links.size(); i++) {
+					const RigidBody& link = *links[i];
+					targets[i] = getChange(link.position, poses[i]) * (1.0 / dt);
+					targets[i] += join(link.velocity.orientation.getRotation(), link.velocity.linear);
+				}
+				setImpulses();
+				respond(1.0);
+			}
+			writePositions(false);
+			writeVelocities();
+		}
+
+		// contacts solve the links as free bodies. while they do, each link takes on the mass it has in the
+		// articulation, as near as a body's mass can say it, so the velocities they leave the links with are
+		// about what the whole articulation could give them, rather than what the link alone would take
+		void lendMatter() {
+			for (int i = 0; i < links.size(); i++) {
+				inertias[i] = getInertia(i);
+				biases[i] = Spatial();
+			}
+			factor();
+
+			for (int i = 0; i < links.size(); i++) {
+				RigidBody& link = *links[i];
+				if (!link.getDynamic()) continue;
+
+				// how the link's own motion answers an impulse on it, one axis at a time
+				SpatialInertia response (0.0);
+				for (int k = 0; k < SPATIAL; k++) {
+					for (Spatial& force : forces)
+						force = Spatial();
+					forces[i][k] = -1.0;
+					propagate();
+					for (int j = 0; j < SPATIAL; j++)
+						response[j][k] = accelerations[i][j];
+				}
+
+				// a body weighs the same every way, so it takes the way the link is easiest to move
+				Matter& matter = lent[i];
+				matter.invMass = 0.0;
+				for (int k = SPATIAL - DIM; k < SPATIAL; k++)
+					matter.invMass = std::max(matter.invMass, response[k][k]);
+#if IS_3D
+				for (int r = 0; r < 3; r++)
+					for (int c = 0; c < 3; c++)
+						matter.invInertia[r][c] = response[r][c];
+				matter.inertia = matter.invInertia.concreteInverse();
+#else
+				matter.invInertia = response[0][0];
+				matter.inertia = 1.0 / matter.invInertia;
+#endif
+				matter.mass = 1.0 / matter.invMass;
+				link.lendMatter(matter);
+			}
+			lending = true;
+		}
+
+		void returnMatter() {
+			lending = false;
+			for (RigidBody* link : links)
+				if (link->getDynamic()) link->syncMatter();
+		}
+
+		// over a small step, a link's velocity is its motion plus however far it was pushed from where it was placed.
+		// taking it from how far the body moved would hand the articulation its average motion over the substep instead,
+		// which lags behind the motion at the end of it and feeds energy in once the links whip around
+		void recomputeVelocities(double dt) {
+			for (int i = 0; i < links.size(); i++) {
+				RigidBody& link = *links[i];
+				if (!link.getDynamic()) continue;
+
+				Spatial motion = motions[i] + getChange(poses[i], link.position) * (1.0 / dt);
+				link.velocity = Transform(getLinear(motion), Orientation(getAngular(motion)));
+			}
+		}
+
+		// the same for whatever changed the links' velocities
+		void absorbVelocities() {
+			bool changed = false;
+			for (int i = 0; i < links.size(); i++) {
+				const RigidBody& link = *links[i];
+				targets[i] = join(link.velocity.orientation.getRotation(), link.velocity.linear);
+				if (link.getDynamic() && !(targets[i] == motions[i])) changed = true;
+			}
+			if (!changed) return;
+
+			setImpulses();
+			respond(1.0);
+			writeVelocities();
+		}
+};
+
+// links don't collide with each other, or with a fixed root that isn't a link of its own
+bool RigidBody::isArticulatedWith(const RigidBody& other) const {
+	if (!articulation) return other.articulation && other.articulation->getLinks()[0] == this;
+	return articulation == other.articulation || articulation->getLinks()[0] == &other;
+}
@@ -5,15 +5,24 @@
 
 class Collision {
 	public:
+		// manifolds are reduced to this many points, so constraints can store them inline
+		static constexpr int MAX_CONTACTS = IF_3D(4, 2);
+
 		Vector normal;
 		double penetration;
 		std::vector<Vector> contacts;
+		// how far each contact is inside the other shape along the normal, at most the penetration
+		std::vector<double> depths;
 		bool dynamic;
 
-		Collision(const Vector& _normal, double _penetration, const std::vector<Vector>& _contacts) {
+		Collision(
+			const Vector& _normal, double _penetration,
+			const std::vector<Vector>& _contacts, const std::vector<double>& _depths = { }
+		) {
 			normal = _normal;
 			penetration = _penetration;
 			contacts = _contacts;
+			depths = _depths.empty() ? std::vector<double>(contacts.size(), penetration) : _depths;
 		}
 
 		void invert() {
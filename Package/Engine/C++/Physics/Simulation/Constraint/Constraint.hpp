@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../RigidBody.hpp"
+#include "../SolverBodies.hpp"
 
 API class Constrained {
 	public:
@@ -47,6 +48,15 @@ class Interaction {
 			crossB = cross(contactB, axis);
 		}
 
+		// a row that only turns the bodies relative to each other, about the axis
+		static Interaction turning(const Cross& axis) {
+			Interaction row (Vector(0.0), Vector(0.0));
+			row.axis = Vector(0.0);
+			row.crossA = axis;
+			row.crossB = axis;
+			return row;
+		}
+
 		friend std::ostream& operator <<(std::ostream& out, const Interaction& in) {
 			out << in.contactA << ", " << in.contactB << "; axis: " << in.axis;
 			return out;
@@ -66,22 +76,40 @@ class Constraint {
 
 	public:
 		bool dynamic;
+		// b is kinematic, so it isn't pushed but its velocity still counts
+		bool movingB;
 		RigidBody& bodyA;
 		RigidBody& bodyB;
 		Matter matterB;
 
+		// where velocity iterations find the bodies, set when the resolver gathers them
+		SolverBodies* solver = nullptr;
+		uint32_t indexA, indexB;
+
 		Constraint(bool _dynamic, RigidBody& _bodyA, RigidBody& _bodyB)
-		: dynamic(_dynamic), bodyA(_bodyA), bodyB(_bodyB) {
+		: bodyA(_bodyA), bodyB(_bodyB) {
+			prepare(_dynamic);
+		}
+
+		// refreshes what is taken from the bodies, for constraints kept across steps
+		void prepare(bool _dynamic) {
+			dynamic = _dynamic;
+			movingB = !dynamic && bodyB.getKinematic();
 			matterB = dynamic ? bodyB.matter : Matter::STATIC;
 		}
 		virtual ~Constraint() { }
+		// caches whatever the velocity iterations need, once the positions are final for the substep
+		virtual void prestep(double dt) { }
 		virtual void solvePosition(double dt) = 0;
 		virtual void solveVelocity(double dt) = 0;
+		// a single soft projection of the positions, for small steps. constraints without compliance just solve their position
+		virtual void solveCompliantPosition(double dt) { solvePosition(dt); }
 		virtual double getError() const { return 0; }
 
 		Vector getInteractionVelocity(const Interaction& interaction) const {
-			Vector velocity = -bodyA.getPointVelocity(interaction.contactA);
-			if (dynamic) velocity += bodyB.getPointVelocity(interaction.contactB);
+			Vector velocity = -solver->getPointVelocity(indexA, interaction.contactA);
+			if (dynamic) velocity += solver->getPointVelocity(indexB, interaction.contactB);
+			else if (movingB) velocity += bodyB.getPointVelocity(interaction.contactB);
 			return velocity;
 		}
 		
@@ -103,37 +131,86 @@ class Constraint {
 				const Interaction& interaction = interactions[i];
 				Vector impulse = interaction.axis * -impulses[i];
 
-				bodyA.applyRelativeImpulse<D>(interaction.contactA, impulse);
-				if (dynamic) bodyB.applyRelativeImpulse<D>(interaction.contactB, -impulse);
+				if constexpr (D == &RigidBody::velocity) {
+					solver->applyImpulse(indexA, interaction.contactA, impulse);
+					if (dynamic) solver->applyImpulse(indexB, interaction.contactB, -impulse);
+				} else {
+					bodyA.applyRelativeImpulse<D>(interaction.contactA, impulse);
+					if (dynamic) bodyB.applyRelativeImpulse<D>(interaction.contactB, -impulse);
+				}
 			}
 		}
 
+		// the relative velocity along a row, going by its cross terms rather than its contacts,
+		// so that it also works for rows that only turn the bodies
+		double getRowVelocity(const Interaction& row) const {
+			double velocity = -dot(solver->linear[indexA], row.axis) - dot(solver->angular[indexA], row.crossA);
+			if (dynamic) velocity += dot(solver->linear[indexB], row.axis) + dot(solver->angular[indexB], row.crossB);
+			else if (movingB) velocity += dot(bodyB.velocity.linear, row.axis) + dot(bodyB.velocity.orientation.getRotation(), row.crossB);
+			return velocity;
+		}
+
+		// pushes the bodies apart along a row by the impulse, the same way applyImpulses does
+		template <Derivative D>
+		void applyRowImpulse(const Interaction& row, double impulse) {
+			if constexpr (D == &RigidBody::velocity) {
+				solver->applyImpulseAndTorque(indexA, row.axis * -impulse, row.crossA * -impulse);
+				if (dynamic) solver->applyImpulseAndTorque(indexB, row.axis * impulse, row.crossB * impulse);
+			} else {
+				bodyA.applyImpulseAndTorque<D>(row.axis * -impulse, row.crossA * -impulse);
+				if (dynamic) bodyB.applyImpulseAndTorque<D>(row.axis * impulse, row.crossB * impulse);
+			}
+		}
+
+		// the single interaction case of getDeltaToImpulsesMatrix, without building and inverting a matrix
+		double getDeltaToImpulse(const Interaction& interaction, double restitution = 0.0) const {
+			double dvPerImpulse = (-1.0 - restitution) * (
+				bodyA.matter.invMass + matterB.invMass +
+				dot(bodyA.matter.invInertia * interaction.crossA, interaction.crossA) +
+				dot(matterB.invInertia * interaction.crossB, interaction.crossB)
+			);
+
+			return 1.0 / dvPerImpulse;
+		}
+
+		// how much each interaction's relative velocity changes per unit of impulse along each of the others
 		template <int N>
-		std::optional<MatrixRC<N>> getDeltaToImpulsesMatrix(
-			const Interaction* interactions, double restitution = 0.0
-		) {
-			double dvFactor = -1.0 - restitution;
+		MatrixRC<N> getResponseMatrix(const Interaction* interactions) const {
+			return getResponseMatrix<N>(interactions, bodyA.matter.invMass, bodyA.matter.invInertia, matterB.invMass, matterB.invInertia);
+		}
 
-			MatrixRC<N> impulsesToDV;
+		// the same, for bodies with the given inverse mass and inertia rather than their own
+		template <int N>
+		static MatrixRC<N> getResponseMatrix(
+			const Interaction* interactions,
+			double invMassA, const Inertia& invInertiaA,
+			double invMassB, const Inertia& invInertiaB
+		) {
+			MatrixRC<N> response;
 			for (int j = 0; j < N; j++)
 			for (int i = 0; i <= j; i++) {
 				const Interaction& dst = interactions[i];
 				const Interaction& src = interactions[j];
 
-				impulsesToDV[i][j] = dvFactor * (
-					bodyA.matter.invMass + matterB.invMass +
-					dot(bodyA.matter.invInertia * src.crossA, dst.crossA) +
-					dot(matterB.invInertia * src.crossB, dst.crossB)
+				response[i][j] = (
+					invMassA + invMassB +
+					dot(invInertiaA * src.crossA, dst.crossA) +
+					dot(invInertiaB * src.crossB, dst.crossB)
 				);
 			}
 
 			for (int j = 0; j < N - 1; j++)
 			for (int i = j + 1; i < N; i++)
-				impulsesToDV[i][j] = impulsesToDV[j][i];
+				response[i][j] = response[j][i];
 
-			std::optional<MatrixRC<N>> result = impulsesToDV.inverse();
+			return response;
+		}
 
-			return result;
+		template <int N>
+		std::optional<MatrixRC<N>> getDeltaToImpulsesMatrix(
+			const Interaction* interactions, double restitution = 0.0
+		) {
+			return (getResponseMatrix<N>(interactions) * (-1.0 - restitution)).inverse();
 		}
 };
 
@@ -142,7 +219,7 @@ class Constraint2 : public Constraint {
 		Constrained& a;
 		Constrained& b;
 		Interaction interaction;
-		Matrix1 dvToImpulses;
+		double dvToImpulse;
 
 		void generateInteraction() {
 			Vector endA = a.getAnchor();
@@ -155,13 +232,33 @@ class Constraint2 : public Constraint {
 				axis.normalize()
 			};
 
-			dvToImpulses = *getDeltaToImpulsesMatrix<1>(&interaction);
+			dvToImpulse = getDeltaToImpulse(interaction);
 		}
 
 	public:
+		// for the constraint made from b's end, the one made from a's, which does the same job when both bodies move
+		Constraint2* twin = nullptr;
+
 		Constraint2(bool _dynamic, Constrained& _a, Constrained& _b)
 		: Constraint(_dynamic, _a.body, _b.body), a(_a), b(_b) { }
 
+		void prestep(double dt) override {
+			generateInteraction();
+		}
+
+		// for solving exactly, how many rows the constraint is taken as, none meaning it can't be
+		virtual int getRowCount() const {
+			return 1;
+		}
+
+		// refreshes the rows from where the bodies are now, writing down each and how far off it is along it
+		virtual void getPositionRows(Interaction* rows, double* deltas) = 0;
+
+		// the rows as of the last prestep
+		virtual void getVelocityRows(Interaction* rows) const {
+			rows[0] = interaction;
+		}
+
 		void recomputeVelocity(double dt) {
 			bodyA.recomputeVelocity(dt);
 			if (dynamic) bodyB.recomputeVelocity(dt);
@@ -2,6 +2,7 @@
 
 #include <type_traits>
 #include <algorithm>
+#include <bit>
 
 #include "Constraint.hpp"
 #include "../Collision.hpp"
@@ -10,31 +11,251 @@ class ContactConstraint : public Constraint {
 	private:
 		constexpr static int BLOCK = 2;
 		constexpr static double IMPULSE_EPSILON = 1e-9;
+		constexpr static int BLOCKS = (Collision::MAX_CONTACTS + BLOCK - 1) / BLOCK;
+		constexpr static int QUAD = 4;
+		constexpr static int TANGENTS = DIM - 1;
 
-		std::vector<Interaction> interactions;
 		struct MatrixBlock {
 			std::optional<MatrixRC<BLOCK>> full;
 			Matrix1 diagonal[BLOCK];
 		};
-		std::vector<MatrixBlock> dvToImpulses;
+
+		// stored inline so that pooled constraints never touch the heap
+		Interaction interactions[Collision::MAX_CONTACTS];
+		MatrixBlock dvToImpulses[BLOCKS];
+		int count;
 		double staticFriction, kineticFriction;
 		double penetration;
+		double restitution;
+
+		// friction rows along a tangent basis shared by the whole manifold.
+		// impulses build up over the step, and friction is bounded by the normal impulse built up so far
+		Interaction tangentInteractions[Collision::MAX_CONTACTS][TANGENTS];
+		double tangentDvToImpulses[Collision::MAX_CONTACTS][TANGENTS];
+		double tangentImpulses[Collision::MAX_CONTACTS][TANGENTS];
+		double normalImpulses[Collision::MAX_CONTACTS];
+		bool coneFriction;
+
+		// for small steps, each point as fixed on either body, so the overlap can be measured again after they move.
+		// normalImpulses then hold the positional impulses of the substep, and approach speeds are taken before any of them
+		Vector anchorsA[Collision::MAX_CONTACTS], anchorsB[Collision::MAX_CONTACTS];
+		double approachSpeeds[Collision::MAX_CONTACTS];
+		double compliance;
+
+		static void getTangents(const Vector& normal, Vector (&tangents)[TANGENTS]) {
+#if IS_3D
+			Vector reference = std::abs(normal[0]) < 0.57 ? Vector(1.0, 0.0, 0.0) : Vector(0.0, 1.0, 0.0);
+			tangents[0] = cross(normal, reference).normalize();
+			tangents[1] = cross(normal, tangents[0]);
+#else
+			tangents[0] = normal.normal();
+#endif
+		}
+
+#if IS_3D
+		// four point manifolds, the usual face contact, are also solved as a single block
+		MatrixRC<QUAD> quadResponse;
+		std::optional<MatrixRC<QUAD>> quadDvToImpulse;
+
+		// subsets of the four points, largest first
+		constexpr static int QUAD_SETS[] = { 15, 7, 11, 13, 14, 3, 5, 6, 9, 10, 12, 1, 2, 4, 8 };
+		constexpr static double QUAD_SOFTNESS = 1e-9;
+
+		// four points on a face only have three degrees of freedom between them, so their block is singular.
+		// a touch of softness on the diagonal settles on the smallest impulses that do the job
+		template <int N>
+		std::optional<MatrixRC<N>> getSoftDvToImpulse(MatrixRC<N> response) const {
+			double softness = 0.0;
+			for (int i = 0; i < N; i++)
+				softness += response[i][i];
+			softness *= QUAD_SOFTNESS / N;
+
+			for (int i = 0; i < N; i++)
+				response[i][i] += softness;
+
+			return (response * (-1.0 - restitution)).inverse();
+		}
+
+		// pushes apart just the points in set, if that needs no pulling and leaves none of the others approaching
+		template <int N>
+		bool trySolveSet(int set, const VectorN<QUAD>& delta) {
+			int rows[N];
+			for (int i = 0, n = 0; i < QUAD; i++)
+				if (set >> i & 1) rows[n++] = i;
+
+			VectorN<N> subDelta;
+			for (int a = 0; a < N; a++) {
+				subDelta[a] = delta[rows[a]];
+				if (subDelta[a] > EPSILON) return false;
+			}
+
+			std::optional<MatrixRC<N>> dvToImpulse;
+			if constexpr (N == QUAD) {
+				dvToImpulse = quadDvToImpulse;
+			} else {
+				MatrixRC<N> response;
+				for (int a = 0; a < N; a++)
+				for (int b = 0; b < N; b++)
+					response[a][b] = quadResponse[rows[a]][rows[b]];
+				dvToImpulse = getSoftDvToImpulse<N>(response);
+			}
+			if (!dvToImpulse) return false;
+
+			VectorN<N> impulses = *dvToImpulse * subDelta;
+			for (int a = 0; a < N; a++)
+				if (impulses[a] < IMPULSE_EPSILON) return false;
+
+			for (int i = 0; i < QUAD; i++) {
+				if (set >> i & 1) continue;
+				double after = delta[i];
+				for (int a = 0; a < N; a++)
+					after += quadResponse[i][rows[a]] * impulses[a];
+				if (after < -EPSILON) return false;
+			}
+
+			for (int a = 0; a < N; a++)
+				applyImpulses<&RigidBody::velocity, 1>(&interactions[rows[a]], impulses[a]);
+
+			for (int a = 0; a < N; a++)
+				normalImpulses[rows[a]] += impulses[a];
+
+			return true;
+		}
+#endif
+
+		// a small LCP over all four points, found by trying each set of them in turn.
+		// returns false when there aren't four points or no set works, leaving it to the blocks of two
+		bool solveQuad() {
+#if IS_3D
+			if (count != QUAD || !quadDvToImpulse) return false;
+
+			VectorN<QUAD> delta = getVelocityDelta<QUAD>(interactions);
+			if (isWasteful(delta)) return true;
+
+			for (int set : QUAD_SETS) {
+				bool solved;
+				switch (std::popcount((unsigned)set)) {
+					case 4: solved = trySolveSet<4>(set, delta); break;
+					case 3: solved = trySolveSet<3>(set, delta); break;
+					case 2: solved = trySolveSet<2>(set, delta); break;
+					default: solved = trySolveSet<1>(set, delta);
+				}
+				if (solved) return true;
+			}
+#endif
+			return false;
+		}
+
+		void solveFriction(int index) {
+			double limit = normalImpulses[index] * staticFriction;
+			if (limit < IMPULSE_EPSILON) return;
+
+			double* accumulated = tangentImpulses[index];
+			double next[TANGENTS];
+			for (int t = 0; t < TANGENTS; t++) {
+				const Interaction& interaction = tangentInteractions[index][t];
+				double dv = dot(getInteractionVelocity(interaction), interaction.axis);
+				next[t] = accumulated[t] + tangentDvToImpulses[index][t] * dv;
+			}
+
+			// past the static limit, the contact slips and only kinetic friction holds it back
+			double slip = normalImpulses[index] * kineticFriction;
+			if (coneFriction) {
+				double mag = 0.0;
+				for (int t = 0; t < TANGENTS; t++)
+					mag += next[t] * next[t];
+				mag = std::sqrt(mag);
+
+				if (mag > limit)
+					for (int t = 0; t < TANGENTS; t++)
+						next[t] *= slip / mag;
+			} else {
+				for (int t = 0; t < TANGENTS; t++)
+					if (std::abs(next[t]) > limit)
+						next[t] = sign(next[t]) * slip;
+			}
+
+			for (int t = 0; t < TANGENTS; t++) {
+				applyImpulses<&RigidBody::velocity, 1>(&tangentInteractions[index][t], next[t] - accumulated[t]);
+				accumulated[t] = next[t];
+			}
+		}
+
+		void solveFrictions() {
+			for (int i = 0; i < count; i++)
+				solveFriction(i);
+		}
+
+		template <int N>
+		bool trySetBounce(const Interaction* current, int index) {
+			for (int i = 0; i < N; i++)
+				if (normalImpulses[index + i] <= 0.0) return false;
+
+			std::optional<MatrixRC<N>> dvToImpulse = getDeltaToImpulsesMatrix<N>(&current[index]);
+			if (!dvToImpulse) return false;
+
+			VectorN<N> change;
+			for (int i = 0; i < N; i++) {
+				double bounce = std::max(-restitution * approachSpeeds[index + i], 0.0);
+				change[i] = dot(getInteractionVelocity(current[index + i]), current[index + i].axis) - bounce;
+			}
+
+			// points already leaving fast enough are never pulled back, a single one being done with
+			VectorN<N> impulses = *dvToImpulse * change;
+			for (int i = 0; i < N; i++)
+				if (impulses[i] < 0.0) return N == 1;
+
+			applyImpulses<&RigidBody::velocity, N>(&current[index], impulses);
+			return true;
+		}
+
+		// the interaction through a point's anchors, wherever the bodies are now
+		Interaction getAnchoredInteraction(int index, const Vector& axis) const {
+			return Interaction(
+				bodyA.position * anchorsA[index] - bodyA.position.linear,
+				bodyB.position * anchorsB[index] - bodyB.position.linear,
+				axis
+			);
+		}
+
+		// moves the bodies so that the points no longer overlap, if every one of them does and none needs pulling
+		template <int N>
+		bool tryPushOut(int index, double softness) {
+			Interaction current[N];
+			VectorN<N> depth;
+			for (int i = 0; i < N; i++) {
+				current[i] = getAnchoredInteraction(index + i, interactions[index + i].axis);
+				depth[i] = dot(bodyA.position * anchorsA[index + i] - bodyB.position * anchorsB[index + i], current[i].axis);
+				if (depth[i] <= 0.0) return false;
+			}
+
+			MatrixRC<N> response = getResponseMatrix<N>(current);
+			for (int i = 0; i < N; i++)
+				response[i][i] += softness;
 
-		void solveFriction(Interaction interaction, double normalImpulse) {
-			Vector velocity = getInteractionVelocity(interaction);
-			Vector tangent = velocity.without(interaction.axis);
-			double mag = tangent.mag();
-			if (mag < EPSILON) return;
-			interaction.setAxis(tangent / mag);
+			std::optional<MatrixRC<N>> inverse = response.inverse();
+			if (!inverse) return false;
 
-			Matrix1 dvToImpulse = *getDeltaToImpulsesMatrix<1>(&interaction);
-			Vector1 delta = dot(velocity, interaction.axis);
-			double impulse = (double)(dvToImpulse * delta);
+			VectorN<N> impulses = *inverse * depth;
+			for (int i = 0; i < N; i++)
+				if (impulses[i] < 0.0) return false;
+
+			applyImpulses<&RigidBody::position, N>(current, impulses);
+			for (int i = 0; i < N; i++)
+				normalImpulses[index + i] += impulses[i];
 
-			if (abs(impulse) > normalImpulse * staticFriction)
-				impulse = sign(impulse) * normalImpulse * kineticFriction;
+			return true;
+		}
 
-			applyImpulses<&RigidBody::velocity, 1>(&interaction, impulse);
+		template <int N>
+		std::optional<MatrixRC<N>> getSolverDvToImpulses(int index) const {
+			MatrixRC<N> response = getResponseMatrix<N>(
+				&interactions[index],
+				solver->invMass[indexA], solver->invInertia[indexA],
+				dynamic ? solver->invMass[indexB] : matterB.invMass,
+				dynamic ? solver->invInertia[indexB] : matterB.invInertia
+			);
+			return (response * (-1.0 - restitution)).inverse();
 		}
 
 		template <int N>
@@ -53,9 +274,8 @@ class ContactConstraint : public Constraint {
 
 			applyImpulses<&RigidBody::velocity, N>(&interactions[index], impulses);
 
-			// friction
 			for (int i = 0; i < N; i++)
-				solveFriction(interactions[index + i], impulses[i]);
+				normalImpulses[index + i] += impulses[i];
 
 			return true;
 		}
@@ -68,27 +288,33 @@ class ContactConstraint : public Constraint {
 				if (block.full && trySolve<N>(*block.full, index))
 					return;
 
-			int count = std::min(BLOCK, (int)interactions.size() - index);
+			int blockSize = std::min(BLOCK, count - index);
 
-			for (int i = 0; i < count; i++)
+			for (int i = 0; i < blockSize; i++)
 				trySolve<1>(block.diagonal[i], index + i);
 		}
 
 	public:
-		ContactConstraint(bool _dynamic, RigidBody& _bodyA, RigidBody& _bodyB, const Collision& col)
-		: Constraint(_dynamic, _bodyA, _bodyB) {
+		ContactConstraint(
+			bool _dynamic, RigidBody& _bodyA, RigidBody& _bodyB, const Collision& col,
+			bool _coneFriction = true, double _compliance = 0.0
+		)
+		: Constraint(_dynamic, _bodyA, _bodyB), coneFriction(_coneFriction), compliance(_compliance) {
 			Vector axis = col.normal;
-			double restitution = std::max(bodyA.restitution, bodyB.restitution);
+			restitution = std::max(bodyA.restitution, bodyB.restitution);
 
-			int count = col.contacts.size();
+			count = std::min((int)col.contacts.size(), Collision::MAX_CONTACTS);
 			for (int i = 0; i < count; i++) {
 				int index = i & 1 ? count - 1 - i / 2 : i / 2;
 				Vector contact = col.contacts[index];
-				interactions.emplace_back(
+				interactions[i] = {
 					contact - bodyA.position.linear,
 					contact - bodyB.position.linear,
 					axis
-				);
+				};
+
+				anchorsA[i] = bodyA.position.inverse() * contact;
+				anchorsB[i] = bodyB.position.inverse() * (contact - axis * col.depths[index]);
 			}
 			
 			for (int i = 0; i < count; i += BLOCK) {
@@ -102,7 +328,26 @@ class ContactConstraint : public Constraint {
 				for (int j = 0; j < blockSize; j++)
 					block.diagonal[j] = *getDeltaToImpulsesMatrix<1>(&interactions[i + j], restitution);
 
-				dvToImpulses.push_back(block);
+				dvToImpulses[i / BLOCK] = block;
+			}
+
+#if IS_3D
+			if (count == QUAD) {
+				quadResponse = getResponseMatrix<QUAD>(interactions);
+				quadDvToImpulse = getSoftDvToImpulse<QUAD>(quadResponse);
+			}
+#endif
+
+			Vector tangents[TANGENTS];
+			getTangents(axis, tangents);
+			for (int i = 0; i < count; i++) {
+				normalImpulses[i] = 0.0;
+				for (int t = 0; t < TANGENTS; t++) {
+					Interaction& tangent = tangentInteractions[i][t];
+					tangent = { interactions[i].contactA, interactions[i].contactB, tangents[t] };
+					tangentDvToImpulses[i][t] = getDeltaToImpulse(tangent);
+					tangentImpulses[i][t] = 0.0;
+				}
 			}
 
 			staticFriction = bodyA.friction * bodyB.friction;
@@ -128,8 +373,94 @@ class ContactConstraint : public Constraint {
 			bodyA.syncWithPosition();
 		}
 		
+		// XPBD: pushes the points back out of the overlap they have now, softened by compliance, a block at a time
+		// as in solveVelocity. static friction then takes back any sliding over the step so far, while the push allows it
+		void solveCompliantPosition(double dt) override {
+			double softness = compliance / (dt * dt);
+
+			for (int i = 0; i < count; i++) {
+				normalImpulses[i] = 0.0;
+				Interaction interaction = getAnchoredInteraction(i, interactions[i].axis);
+				approachSpeeds[i] = dot(
+					(dynamic || movingB ? bodyB.getPointVelocity(interaction.contactB) : Vector(0.0)) -
+					bodyA.getPointVelocity(interaction.contactA),
+					interaction.axis
+				);
+			}
+
+			for (int i = 0; i < count; i += BLOCK) {
+				if (count - i >= BLOCK && tryPushOut<BLOCK>(i, softness)) continue;
+				for (int j = i; j < std::min(count, i + BLOCK); j++)
+					tryPushOut<1>(j, softness);
+			}
+
+			for (int i = 0; i < count; i++) {
+				if (normalImpulses[i] <= 0.0) continue;
+
+				Vector slide = bodyA.position * anchorsA[i] - bodyA.stepStart * anchorsA[i];
+				if (dynamic) slide -= bodyB.position * anchorsB[i] - bodyB.stepStart * anchorsB[i];
+				slide = slide.without(interactions[i].axis);
+				double mag = slide.mag();
+				if (mag == 0.0) continue;
+
+				Interaction tangent = getAnchoredInteraction(i, slide / mag);
+				double impulse = mag / (-1.0 / getDeltaToImpulse(tangent) + softness);
+				if (impulse < staticFriction * normalImpulses[i])
+					applyImpulses<&RigidBody::position, 1>(&tangent, impulse);
+			}
+		}
+
+		// after velocities are taken from the positions: the touching points leave at the speed restitution asks for,
+		// a block at a time, then sliding friction takes away what the normal impulse of the substep allows.
+		// the pushes already leave inelastic contacts at rest, and correcting those again only shakes stacks
+		void solveCompliantVelocity(double dt) {
+			Interaction current[Collision::MAX_CONTACTS];
+			for (int i = 0; i < count; i++)
+				current[i] = getAnchoredInteraction(i, interactions[i].axis);
+
+			if (restitution > 0.0) {
+				for (int i = 0; i < count; i += BLOCK) {
+					if (count - i >= BLOCK && trySetBounce<BLOCK>(current, i)) continue;
+					for (int j = i; j < std::min(count, i + BLOCK); j++)
+						trySetBounce<1>(current, j);
+				}
+			}
+
+			for (int i = 0; i < count; i++) {
+				if (normalImpulses[i] <= 0.0) continue;
+
+				Vector sliding = getInteractionVelocity(current[i]).without(current[i].axis);
+				double mag = sliding.mag();
+				if (mag < EPSILON) continue;
+
+				Interaction tangent = current[i];
+				tangent.setAxis(sliding / mag);
+				double dvToImpulse = getDeltaToImpulse(tangent);
+				double limit = kineticFriction * normalImpulses[i] / dt;
+				applyImpulses<&RigidBody::velocity, 1>(&tangent, std::max(dvToImpulse * mag, -limit));
+			}
+		}
+
 		void solveVelocity(double dt) override {
-			for (int i = 0; i < interactions.size(); i += BLOCK)
-				solve<BLOCK>(i);
+			if (!solveQuad())
+				for (int i = 0; i < count; i += BLOCK)
+					solve<BLOCK>(i);
+
+			solveFrictions();
+		}
+
+		// one more pass over the points with whatever masses the solver holds right now.
+		// shock propagation zeroes them for the bodies underneath, so the blocks are inverted afresh
+		void solveShock() {
+			for (int i = 0; i < count; i += BLOCK) {
+				if (count - i >= BLOCK) {
+					std::optional<MatrixRC<BLOCK>> full = getSolverDvToImpulses<BLOCK>(i);
+					if (full && trySolve<BLOCK>(*full, i)) continue;
+				}
+
+				for (int j = i; j < std::min(count, i + BLOCK); j++)
+					if (std::optional<Matrix1> single = getSolverDvToImpulses<1>(j))
+						trySolve<1>(*single, j);
+			}
 		}
 };
\ No newline at end of file
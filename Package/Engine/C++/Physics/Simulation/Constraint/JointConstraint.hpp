@@ -0,0 +1,330 @@
+#pragma once
+
+#include "Constraint.hpp"
+
+// what every joint keeps: an axis and a resting orientation between the bodies, fixed as they were when it was made,
+// and a limit and motor along whichever way the joint is left free to move
+class JointConstraint : public Constraint2 {
+	public:
+		// the axis in each body's own space
+		Vector axisA, axisB;
+		// b's orientation relative to a's at rest
+		Orientation reference;
+		// made from b's end of the descriptor, which sees every angle and distance the other way around
+		bool flipped;
+
+		bool hasLimit = false;
+		bool hasMotor = false;
+		double lower = 0.0;
+		double upper = 0.0;
+		double motorSpeed = 0.0;
+		double maxMotorForce = 0.0;
+
+		JointConstraint(
+			bool _dynamic, Constrained& _a, Constrained& _b,
+			const Vector& _axisA, const Vector& _axisB, const Orientation& _reference, bool _flipped
+		)
+		: Constraint2(_dynamic, _a, _b) {
+			axisA = _axisA;
+			axisB = _axisB;
+			reference = _reference;
+			flipped = _flipped;
+		}
+
+		// limits and motors can't be solved exactly, since they only push one way or only so hard
+		int getRowCount() const override {
+			return hasLimit || hasMotor ? 0 : getBlockSize();
+		}
+
+		virtual int getBlockSize() const = 0;
+};
+
+// a joint that holds LINEAR directions of the anchors' separation and ANGULAR directions of the bodies' relative
+// turning at zero, all as one block, so that a hinge is a single small solve rather than several constraints pulling
+// against each other. linear rows come first, along the world axes or across the slide axis,
+// then angular rows, along the world axes or across the hinge axis
+template <int LINEAR, int ANGULAR>
+class BlockJointConstraint : public JointConstraint {
+	private:
+		static constexpr int N = LINEAR + ANGULAR;
+		static constexpr int ROTATION_AXES = IF_3D(3, 1);
+		// joints that hold everything but one way of moving, which the limit and motor act along
+		static constexpr bool FREE = N < DIM + ROTATION_AXES;
+		// keeps the block positive definite when some of its rows can't move the bodies apart at all,
+		// as for the turning rows of a joint between bodies that can't rotate
+		static constexpr double SOFTNESS = 1e-9;
+
+		Interaction rows[N];
+		MatrixRC<N> dvToImpulses;
+
+		Interaction freeRow;
+		double freeDvToImpulse;
+		double lowerGap, upperGap;
+		double motorImpulse, lowerImpulse, upperImpulse;
+
+		Inertia getInvInertia(const RigidBody& body, const Matter& matter) const {
+			return body.canRotate ? matter.invInertia : matter.invInertia * 0.0;
+		}
+
+		static void getPerpendiculars(const Vector& axis, Vector (&perpendiculars)[DIM - 1]) {
+#if IS_3D
+			Vector reference = std::abs(axis[0]) < 0.57 ? Vector(1.0, 0.0, 0.0) : Vector(0.0, 1.0, 0.0);
+			perpendiculars[0] = cross(axis, reference).normalize();
+			perpendiculars[1] = cross(axis, perpendiculars[0]);
+#else
+			perpendiculars[0] = axis.normal();
+#endif
+		}
+
+		// how far b has turned from where a holds it, as a rotation in world space
+		Rotation getTurn() const {
+			return (bodyB.position.orientation * -(bodyA.position.orientation * reference)).getRotation();
+		}
+
+		void getRows(Interaction* result, double* deltas) const {
+			Vector endA = a.getAnchor();
+			Vector endB = b.getAnchor();
+			Vector contactA = endA - bodyA.position.linear;
+			Vector contactB = endB - bodyB.position.linear;
+			Vector separation = endB - endA;
+
+			Vector linearAxes[LINEAR];
+			if constexpr (LINEAR == DIM) {
+				for (int i = 0; i < DIM; i++) {
+					linearAxes[i] = Vector(0.0);
+					linearAxes[i][i] = 1.0;
+				}
+			} else {
+				getPerpendiculars(bodyA.position.orientation * axisA, linearAxes);
+			}
+
+			for (int i = 0; i < LINEAR; i++) {
+				result[i] = Interaction(contactA, contactB, linearAxes[i]);
+				deltas[i] = dot(separation, linearAxes[i]);
+			}
+
+			if constexpr (ANGULAR == ROTATION_AXES) {
+				Rotation turn = getTurn();
+				for (int i = 0; i < ANGULAR; i++) {
+					Rotation axis = Rotation(0.0);
+					IF_3D(axis[i], axis) = 1.0;
+					result[LINEAR + i] = Interaction::turning(axis);
+					deltas[LINEAR + i] = dot(turn, axis);
+				}
+			} else if constexpr (ANGULAR > 0) {
+#if IS_3D
+				// only the hinge axes have to line up, which they do when their cross product vanishes
+				Vector hingeA = bodyA.position.orientation * axisA;
+				Vector hingeB = bodyB.position.orientation * axisB;
+				Vector misalignment = cross(hingeA, hingeB);
+
+				Vector perpendiculars[DIM - 1];
+				getPerpendiculars(hingeA, perpendiculars);
+				for (int i = 0; i < ANGULAR; i++) {
+					result[LINEAR + i] = Interaction::turning(perpendiculars[i]);
+					deltas[LINEAR + i] = dot(misalignment, perpendiculars[i]);
+				}
+#endif
+			}
+		}
+
+		// the angle turned about the hinge for revolute joints, or the distance slid along the axis for prismatic ones
+		Interaction getFreeRow(double& coordinate) const {
+			if constexpr (LINEAR == DIM) {
+				Cross hinge = IF_3D(bodyA.position.orientation * axisA, 1.0);
+				coordinate = dot(getTurn(), hinge);
+				return Interaction::turning(hinge);
+			} else {
+				Vector endA = a.getAnchor();
+				Vector endB = b.getAnchor();
+				Vector slide = bodyA.position.orientation * axisA;
+				coordinate = dot(endB - endA, slide);
+				return Interaction(endA - bodyA.position.linear, endB - bodyB.position.linear, slide);
+			}
+		}
+
+		template <int M>
+		MatrixRC<M> getResponse(const Interaction* along) const {
+			Inertia invInertiaA = getInvInertia(bodyA, bodyA.matter);
+			Inertia invInertiaB = dynamic ? getInvInertia(bodyB, matterB) : matterB.invInertia;
+			double invMass = bodyA.matter.invMass + matterB.invMass;
+
+			MatrixRC<M> response;
+			for (int j = 0; j < M; j++)
+			for (int i = 0; i <= j; i++) {
+				response[i][j] = response[j][i] = (
+					invMass * dot(along[i].axis, along[j].axis) +
+					dot(invInertiaA * along[j].crossA, along[i].crossA) +
+					dot(invInertiaB * along[j].crossB, along[i].crossB)
+				);
+			}
+
+			return response;
+		}
+
+		double getDvToImpulse(const Interaction& row) const {
+			double response = (double)getResponse<1>(&row);
+			return response > 0.0 ? -1.0 / response : 0.0;
+		}
+
+		// factors the block as LDLT in place, with L below the diagonal and D on it.
+		// rows that can't move anything get no pivot, and so no impulse
+		static void factor(MatrixRC<N>& block) {
+			double softness = 0.0;
+			for (int i = 0; i < N; i++)
+				softness += block[i][i];
+			softness *= SOFTNESS / N;
+
+			for (int k = 0; k < N; k++) {
+				double pivot = block[k][k] + softness;
+				for (int p = 0; p < k; p++)
+					pivot -= block[k][p] * block[k][p] * block[p][p];
+				block[k][k] = pivot > softness * 0.5 ? pivot : 0.0;
+
+				for (int i = k + 1; i < N; i++) {
+					double value = block[i][k];
+					for (int p = 0; p < k; p++)
+						value -= block[i][p] * block[k][p] * block[p][p];
+					block[i][k] = block[k][k] ? value / block[k][k] : 0.0;
+				}
+			}
+		}
+
+		// the impulses that cancel the deltas, given a factored block
+		static VectorN<N> getImpulses(const MatrixRC<N>& factored, const double* deltas) {
+			VectorN<N> impulses;
+			for (int i = 0; i < N; i++) {
+				impulses[i] = deltas[i];
+				for (int p = 0; p < i; p++)
+					impulses[i] -= factored[i][p] * impulses[p];
+			}
+
+			for (int i = 0; i < N; i++)
+				impulses[i] = factored[i][i] ? -impulses[i] / factored[i][i] : 0.0;
+
+			for (int i = N - 1; i >= 0; i--)
+				for (int p = i + 1; p < N; p++)
+					impulses[i] -= factored[p][i] * impulses[p];
+
+			return impulses;
+		}
+
+		// both ends of a joint between moving bodies hold it together, but only one of them drives and limits it
+		bool drives() const {
+			return FREE && (!flipped || !dynamic);
+		}
+
+		// clamps the impulse built up along the free row so far, applying just the change
+		void applyFreeImpulse(double& accumulated, double impulse, double min, double max) {
+			double next = std::clamp(accumulated + impulse, min, max);
+			applyRowImpulse<&RigidBody::velocity>(freeRow, next - accumulated);
+			accumulated = next;
+		}
+
+	public:
+		using JointConstraint::JointConstraint;
+
+		int getBlockSize() const override {
+			return N;
+		}
+
+		double getError() const override {
+			Interaction along[N];
+			double deltas[N];
+			getRows(along, deltas);
+
+			double error = 0.0;
+			for (int i = 0; i < N; i++)
+				error += std::abs(deltas[i]);
+
+			if (drives() && hasLimit) {
+				double coordinate;
+				getFreeRow(coordinate);
+				error += std::max(lower - coordinate, 0.0) + std::max(coordinate - upper, 0.0);
+			}
+
+			return isnan(error) ? 0.0 : error;
+		}
+
+		void getPositionRows(Interaction* result, double* deltas) override {
+			getRows(result, deltas);
+		}
+
+		void getVelocityRows(Interaction* result) const override {
+			for (int i = 0; i < N; i++)
+				result[i] = rows[i];
+		}
+
+		void prestep(double dt) override {
+			double deltas[N];
+			getRows(rows, deltas);
+			dvToImpulses = getResponse<N>(rows);
+			factor(dvToImpulses);
+
+			motorImpulse = lowerImpulse = upperImpulse = 0.0;
+			if (drives()) {
+				double coordinate;
+				freeRow = getFreeRow(coordinate);
+				freeDvToImpulse = getDvToImpulse(freeRow);
+				lowerGap = coordinate - lower;
+				upperGap = upper - coordinate;
+			}
+		}
+
+		// the limit goes first, so that the block has the last word on keeping the joint together
+		void solvePosition(double dt) override {
+			if (drives() && hasLimit) {
+				double coordinate;
+				Interaction row = getFreeRow(coordinate);
+				double delta = coordinate < lower ? coordinate - lower : coordinate > upper ? coordinate - upper : 0.0;
+				if (delta) applyRowImpulse<&RigidBody::position>(row, delta * getDvToImpulse(row));
+			}
+
+			Interaction along[N];
+			double deltas[N];
+			getRows(along, deltas);
+			MatrixRC<N> block = getResponse<N>(along);
+			factor(block);
+
+			VectorN<N> impulses = getImpulses(block, deltas);
+			for (int i = 0; i < N; i++)
+				applyRowImpulse<&RigidBody::position>(along[i], impulses[i]);
+		}
+
+		// the limit only stops the joint closing faster than the gap left to it allows,
+		// the way contacts are speculative, since positions are corrected separately
+		void solveVelocity(double dt) override {
+			if (drives()) {
+				if (hasMotor) {
+					double maxImpulse = maxMotorForce * dt;
+					double impulse = (getRowVelocity(freeRow) - motorSpeed) * freeDvToImpulse;
+					applyFreeImpulse(motorImpulse, impulse, -maxImpulse, maxImpulse);
+				}
+
+				if (hasLimit) {
+					double speed = getRowVelocity(freeRow);
+					double impulse = (speed + std::max(lowerGap, 0.0) / dt) * freeDvToImpulse;
+					applyFreeImpulse(lowerImpulse, impulse, 0.0, INFINITY);
+
+					speed = getRowVelocity(freeRow);
+					impulse = (speed - std::max(upperGap, 0.0) / dt) * freeDvToImpulse;
+					applyFreeImpulse(upperImpulse, impulse, -INFINITY, 0.0);
+				}
+			}
+
+			double deltas[N];
+			for (int i = 0; i < N; i++)
+				deltas[i] = getRowVelocity(rows[i]);
+
+			VectorN<N> impulses = getImpulses(dvToImpulses, deltas);
+			for (int i = 0; i < N; i++)
+				applyRowImpulse<&RigidBody::velocity>(rows[i], impulses[i]);
+		}
+};
+
+// holds the anchors together, leaving the bodies free to turn about the hinge axis (in 2D, free to turn at all)
+using RevoluteConstraint = BlockJointConstraint<DIM, IF_3D(2, 0)>;
+// keeps the bodies from turning relative to each other, and b's anchor on the line through a's along the axis
+using PrismaticConstraint = BlockJointConstraint<DIM - 1, IF_3D(3, 1)>;
+// holds the anchors together and the bodies from turning relative to each other
+using WeldConstraint = BlockJointConstraint<DIM, IF_3D(3, 1)>;
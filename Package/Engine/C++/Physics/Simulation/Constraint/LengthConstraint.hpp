@@ -3,10 +3,10 @@
 #include "Constraint.hpp"
 
 class LengthConstraint : public Constraint2 {
-	private:
+	public:
 		double length;
+		double compliance = 0.0;
 
-	public:
 		LengthConstraint(bool _dynamic, Constrained& _a, Constrained& _b, double _length)
 		: Constraint2(_dynamic, _a, _b) {
 			length = _length;
@@ -18,6 +18,13 @@ class LengthConstraint : public Constraint2 {
 			return isnan(error) ? 0.0 : error;
 		}
 
+		void getPositionRows(Interaction* rows, double* deltas) override {
+			generateInteraction();
+			rows[0] = interaction;
+			deltas[0] = (b.getAnchor() - a.getAnchor()).mag() - length;
+		}
+
+		// bodies move between position iterations, so the interaction can't come from the prestep here
 		void solvePosition(double dt) override {
 			generateInteraction();
 
@@ -25,13 +32,23 @@ class LengthConstraint : public Constraint2 {
 			if (equals(sqrMag, length * length)) return;
 
 			Vector1 delta = std::sqrt(sqrMag) - length;
-			applyImpulses<&RigidBody::position, 1>(&interaction, dvToImpulses * delta);
+			applyImpulses<&RigidBody::position, 1>(&interaction, delta * dvToImpulse);
 		}
 
-		void solveVelocity(double dt) override {
+		// XPBD: with one projection per substep nothing has built up yet, so the compliance just softens the inverse mass
+		void solveCompliantPosition(double dt) override {
 			generateInteraction();
 
+			double sqrMag = (b.getAnchor() - a.getAnchor()).sqrMag();
+			if (equals(sqrMag, length * length)) return;
+
+			Vector1 delta = std::sqrt(sqrMag) - length;
+			double softness = compliance / (dt * dt);
+			applyImpulses<&RigidBody::position, 1>(&interaction, delta / (1.0 / dvToImpulse - softness));
+		}
+
+		void solveVelocity(double dt) override {
 			Vector1 delta = getVelocityDelta<1>(&interaction);
-			applyImpulses<&RigidBody::velocity, 1>(&interaction, dvToImpulses * delta);
+			applyImpulses<&RigidBody::velocity, 1>(&interaction, delta * dvToImpulse);
 		}
 };
\ No newline at end of file
@@ -1,10 +1,22 @@
 #pragma once
 
+#include <memory>
+
 #include "RigidBody.hpp"
 #include "Constraint/Constraint.hpp"
 #include "Constraint/LengthConstraint.hpp"
+#include "Constraint/JointConstraint.hpp"
 
 API class ConstraintDescriptor {
+	private:
+		std::unique_ptr<Constraint2> constraints[2];
+
+	protected:
+		virtual Constraint2* makeConstraint(bool dynamic, Constrained& a, Constrained& b) = 0;
+
+		// copies settings that may have changed since the constraint was made
+		virtual void update(Constraint2& constraint) { }
+
 	public:
 		API_CONST Constrained a, b;
 
@@ -26,7 +38,17 @@ API class ConstraintDescriptor {
 			erase(b.body.constraintDescriptors, this);
 		}
 
-		virtual Constraint2* makeConstraint(bool prohibited, Constrained& a, Constrained& b) = 0;
+		// the constraint acting from one end (b's when swapped), made on first use and then reused every step
+		Constraint2* getConstraint(bool dynamic, bool swap) {
+			std::unique_ptr<Constraint2>& constraint = constraints[swap];
+			if (!constraint) {
+				constraint.reset(makeConstraint(dynamic, swap ? b : a, swap ? a : b));
+				if (constraints[0] && constraints[1]) constraints[1]->twin = constraints[0].get();
+			}
+			constraint->prepare(dynamic);
+			update(*constraint);
+			return constraint.get();
+		}
 
 		friend std::ostream& operator <<(std::ostream& out, const ConstraintDescriptor& desc) {
 			out << "Constraint(" << desc.a.getAnchor() << ", " << desc.b.getAnchor() << ")";
@@ -37,15 +59,23 @@ API class ConstraintDescriptor {
 API class LengthConstraintDescriptor : public ConstraintDescriptor {
 	public:
 		API double length;
+		// how far the constraint gives per unit of force when the engine takes small steps, zero being rigid
+		API double compliance = 0.0;
 
 		API LengthConstraintDescriptor(const Constrained& _a, const Constrained& _b, double _length)
 		: ConstraintDescriptor(_a, _b) {
 			length = _length;
 		}
 
+	protected:
 		Constraint2* makeConstraint(bool dynamic, Constrained& a, Constrained& b) override {
 			return new LengthConstraint(dynamic, a, b, length);
 		}
+
+		void update(Constraint2& constraint) override {
+			((LengthConstraint&)constraint).length = length;
+			((LengthConstraint&)constraint).compliance = compliance;
+		}
 };
 
 API class PositionConstraintDescriptor : public ConstraintDescriptor {
@@ -53,7 +83,94 @@ API class PositionConstraintDescriptor : public ConstraintDescriptor {
 		API PositionConstraintDescriptor(const Constrained& _a, const Constrained& _b)
 		: ConstraintDescriptor(_a, _b) { }
 
+	protected:
 		Constraint2* makeConstraint(bool dynamic, Constrained& a, Constrained& b) override {
 			return new LengthConstraint(dynamic, a, b, 0);
 		}
-};
\ No newline at end of file
+};
+
+// what the joints below share: an axis and the orientation between the bodies, both taken from where the bodies are
+// when the joint is made, and a limit and motor along the one way the joint leaves them free to move.
+// the limit is an angle for revolute joints and a distance for prismatic ones, and the motor drives towards
+// its speed with no more than the given force (torque, for revolute joints)
+API class JointConstraintDescriptor : public ConstraintDescriptor {
+	private:
+		Vector axisA, axisB;
+		Orientation reference;
+
+	public:
+		API bool hasLimit = false;
+		API bool hasMotor = false;
+		API double lower = 0.0;
+		API double upper = 0.0;
+		API double motorSpeed = 0.0;
+		API double maxMotorForce = 0.0;
+
+		JointConstraintDescriptor(const Constrained& _a, const Constrained& _b, const Vector& axis)
+		: ConstraintDescriptor(_a, _b) {
+			const Orientation& orientationA = a.body.position.orientation;
+			const Orientation& orientationB = b.body.position.orientation;
+			axisA = -orientationA * axis;
+			axisB = -orientationB * axis;
+			reference = -orientationA * orientationB;
+		}
+
+	protected:
+		template <class T>
+		Constraint2* makeJoint(bool dynamic, Constrained& _a, Constrained& _b) {
+			if (&_a == &b) return new T(dynamic, _a, _b, axisB, axisA, -reference, true);
+			return new T(dynamic, _a, _b, axisA, axisB, reference, false);
+		}
+
+		void update(Constraint2& constraint) override {
+			JointConstraint& joint = (JointConstraint&)constraint;
+			joint.hasLimit = hasLimit;
+			joint.hasMotor = hasMotor;
+			joint.maxMotorForce = maxMotorForce;
+			joint.lower = joint.flipped ? -upper : lower;
+			joint.upper = joint.flipped ? -lower : upper;
+			joint.motorSpeed = joint.flipped ? -motorSpeed : motorSpeed;
+		}
+};
+
+// the bodies turn freely about the axis through the anchors, which are held together
+API class RevoluteConstraintDescriptor : public JointConstraintDescriptor {
+	public:
+#if IS_3D
+		API RevoluteConstraintDescriptor(const Constrained& _a, const Constrained& _b, const Vector& axis)
+		: JointConstraintDescriptor(_a, _b, axis) { }
+#else
+		API RevoluteConstraintDescriptor(const Constrained& _a, const Constrained& _b)
+		: JointConstraintDescriptor(_a, _b, Vector(1.0, 0.0)) { }
+#endif
+
+	protected:
+		Constraint2* makeConstraint(bool dynamic, Constrained& a, Constrained& b) override {
+			return makeJoint<RevoluteConstraint>(dynamic, a, b);
+		}
+};
+
+// b's anchor slides along the axis through a's, without the bodies turning relative to each other
+API class PrismaticConstraintDescriptor : public JointConstraintDescriptor {
+	public:
+		API PrismaticConstraintDescriptor(const Constrained& _a, const Constrained& _b, const Vector& axis)
+		: JointConstraintDescriptor(_a, _b, axis.normalized()) { }
+
+	protected:
+		Constraint2* makeConstraint(bool dynamic, Constrained& a, Constrained& b) override {
+			return makeJoint<PrismaticConstraint>(dynamic, a, b);
+		}
+};
+
+// the anchors are held together and the bodies from turning relative to each other, as though they were one.
+// it has no way to move, so no limit or motor either
+API class WeldConstraintDescriptor : public JointConstraintDescriptor {
+	public:
+		API WeldConstraintDescriptor(const Constrained& _a, const Constrained& _b)
+		: JointConstraintDescriptor(_a, _b, Vector(0.0)) { }
+
+	protected:
+		Constraint2* makeConstraint(bool dynamic, Constrained& a, Constrained& b) override {
+			return makeJoint<WeldConstraint>(dynamic, a, b);
+		}
+};
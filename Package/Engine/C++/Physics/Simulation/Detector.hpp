@@ -6,6 +6,7 @@
 #include "../../Util/Timer.hpp"
 
 #include <memory>
+#include <algorithm>
 
 API class Detector {
 	private:
@@ -68,9 +69,11 @@ API class Detector {
 			return { };
 		}
 
+		// the part of an edge inside the other shape, whose ends bound the overlap of two faces that meet at a twist and
+		// so hold none of each other's vertices. ends only reaching the surface, or already found as vertices, add nothing
 		static void clipEdge(
-			std::vector<Vector>& contacts, const Line& subject,
-			const Polytope& clip, const Plane& separator
+			std::vector<Vector>& contacts, std::vector<double>& depths, const Line& subject,
+			const Polytope& clip, const Plane& separator, double overlap
 		) {
 			Vector a = subject.start;
 			Vector b = subject.end;
@@ -97,20 +100,39 @@ API class Detector {
 				}
 			}
 
-			contacts.push_back(Line(a, b).midpoint());
+			for (const Vector& end : { a, b }) {
+				double depth = std::min(dot(separator.normal, end) - separator.distance, overlap);
+				if (depth <= EPSILON) continue;
+				if (std::any_of(contacts.begin(), contacts.end(), [&](const Vector& contact) {
+					return (contact - end).sqrMag() <= EPSILON * EPSILON;
+				})) continue;
+
+				contacts.push_back(end);
+				depths.push_back(depth);
+			}
 		}
 
 		static void clipVertex(
-			std::vector<Vector>& contacts, const Vector& subject,
-			const Polytope& clip, const Plane& separator
+			std::vector<Vector>& contacts, std::vector<double>& depths,
+			const Vector& subject, const Polytope& clip, const Plane& separator
 		) {
-			if (dot(separator.normal, subject) < separator.distance) return;
+			double depth = dot(separator.normal, subject) - separator.distance;
+			if (depth < 0.0) return;
+
+			// faces that line up exactly leave vertices a rounding error outside each other
+			const Plane* facing = nullptr;
+			for (const Plane& face : clip.planes) {
+				if (dot(face.normal, subject) < face.distance - EPSILON) return;
+				if (!facing || dot(face.normal, separator.normal) > dot(facing->normal, separator.normal))
+					facing = &face;
+			}
 
-			for (const Plane& face : clip.planes)
-				if (dot(face.normal, subject) < face.distance)
-					return;
+			// measured from the face turned most towards the other shape, which tilts with it
+			double inside = std::max(dot(facing->normal, subject) - facing->distance, 0.0);
+			depth = std::min(depth, inside / dot(facing->normal, separator.normal));
 
 			contacts.push_back(subject);
+			depths.push_back(depth);
 		}
 
 		static bool checkAxis(
@@ -177,31 +199,30 @@ API class Detector {
 			Vector normal = bestAxis;
 
 			std::vector<Vector> contacts;
+			std::vector<double> depths;
 			
 			Plane collisionPlaneA { -normal, -a.getMaxExtent(normal) };
 			Plane collisionPlaneB { normal, b.getMinExtent(normal) };
 
 			for (int i = 0; i < a.vertices.size(); i++)
-				clipVertex(contacts, a.vertices[i], b, collisionPlaneB);
+				clipVertex(contacts, depths, a.vertices[i], b, collisionPlaneB);
 
 			for (int i = 0; i < b.vertices.size(); i++)
-				clipVertex(contacts, b.vertices[i], a, collisionPlaneA);
+				clipVertex(contacts, depths, b.vertices[i], a, collisionPlaneA);
 			
-			if (contacts.empty()) {
 #if IS_3D
-				if (contacts.empty()) {
-					for (int i = 0; i < a.getEdgeCount() && contacts.empty(); i++)
-						clipEdge(contacts, a.getEdge(i), b, collisionPlaneB);
-					
-					if (contacts.empty()) {
-						for (int i = 0; i < b.getEdgeCount() && contacts.empty(); i++)
-							clipEdge(contacts, b.getEdge(i), a, collisionPlaneA);
-					}
-				}
-#endif
+			// fewer than three vertices can't hold a face up, as with two equal boxes stacked at a twist, so the
+			// edges crossing into each shape fill in the rest of the overlap
+			if (contacts.size() < 3) {
+				for (int i = 0; i < a.getEdgeCount(); i++)
+					clipEdge(contacts, depths, a.getEdge(i), b, collisionPlaneB, minOverlap);
+
+				for (int i = 0; i < b.getEdgeCount(); i++)
+					clipEdge(contacts, depths, b.getEdge(i), a, collisionPlaneA, minOverlap);
 			}
+#endif
 
-			return Collision(normal, minOverlap, contacts);
+			return Collision(normal, minOverlap, contacts, depths);
 		}
 		
 		static std::optional<Collision> collidePolytopeBall(const Shape& shapeA, const Shape& shapeB) {
@@ -210,15 +231,169 @@ API class Detector {
 			return result;
 		}
 
+		// keeps a well spread subset of a merged manifold: the two extremes along the
+		// tangent in 2D, or a far pair plus the two points widest to either side of it in 3D
+		static void reduceContacts(std::vector<Vector>& contacts, std::vector<double>& depths, const Vector& normal) {
+			if (contacts.size() <= Collision::MAX_CONTACTS) return;
+
+			auto keep = [&](std::initializer_list<int> indices) {
+				std::vector<Vector> keptContacts;
+				std::vector<double> keptDepths;
+				for (int i : indices) {
+					keptContacts.push_back(contacts[i]);
+					keptDepths.push_back(depths[i]);
+				}
+				contacts = std::move(keptContacts);
+				depths = std::move(keptDepths);
+			};
+
+#if IS_3D
+			auto area = [&](int a, int b, int c) {
+				return dot(cross(contacts[b] - contacts[a], contacts[c] - contacts[a]), normal);
+			};
+
+			Vector center { };
+			for (const Vector& contact : contacts)
+				center += contact;
+			center /= contacts.size();
+
+			auto farthest = [&](auto score) {
+				int best = 0;
+				for (int i = 1; i < contacts.size(); i++)
+					if (score(best) < score(i)) best = i;
+				return best;
+			};
+
+			int a = farthest([&](int i) { return (contacts[i] - center).sqrMag(); });
+			int b = farthest([&](int i) { return (contacts[i] - contacts[a]).sqrMag(); });
+			int c = farthest([&](int i) { return std::abs(area(a, b, i)); });
+			if (area(a, b, c) < 0.0) std::swap(a, b);
+			int d = farthest([&](int i) {
+				return std::max({ -area(a, b, i), -area(b, c, i), -area(c, a, i) });
+			});
+
+			// ordered so that the constraint's opposite-end pairing matches far points
+			keep({ a, c, d, b });
+#else
+			Vector tangent = normal.normal();
+			auto [min, max] = std::minmax_element(contacts.begin(), contacts.end(), [&](const Vector& x, const Vector& y) {
+				return dot(x, tangent) < dot(y, tangent);
+			});
+			keep({ (int)(min - contacts.begin()), (int)(max - contacts.begin()) });
+#endif
+		}
+
+		static std::optional<Collision> mergeCollisions(std::vector<Collision>& collisions) {
+			if (collisions.empty()) return { };
+			if (collisions.size() == 1) {
+				reduceContacts(collisions[0].contacts, collisions[0].depths, collisions[0].normal);
+				return collisions[0];
+			}
+
+			Vector dir { };
+			for (const Collision& col : collisions)
+				dir += col.normal * col.penetration;
+
+			std::vector<Vector> contacts;
+			std::vector<double> depths;
+			double length = dir.mag();
+			double penetration = -INFINITY;
+			Collision* best = nullptr;
+
+			for (Collision& col : collisions) {
+				double along = dot(col.normal, dir);
+				if (along < 0.0) continue;
+				contacts.insert(contacts.end(), col.contacts.begin(), col.contacts.end());
+				for (double depth : col.depths)
+					depths.push_back(depth * along / length);
+				if (col.penetration > penetration) {
+					penetration = col.penetration;
+					best = &col;
+				}
+			}
+
+			if (!best || contacts.empty()) return { };
+
+			dir.normalize();
+			reduceContacts(contacts, depths, dir);
+			best->contacts = contacts;
+			best->depths = depths;
+			best->penetration *= dot(best->normal, dir);
+			best->normal = dir;
+
+			return *best;
+		}
+
+#if IS_3D
+		static std::optional<Collision> collideHeightfieldShape(const Shape& shapeA, const Shape& shapeB) {
+			const Heightfield& a = (const Heightfield&)shapeA;
+
+			std::vector<Collision> collisions;
+			for (const Polytope* prism : a.getPrisms(shapeB.getBounds())) {
+				// the prism goes first so that the separating axis is cached on the terrain side
+				std::optional<Collision> col = collide(*prism, shapeB);
+				if (col && !col->contacts.empty()) collisions.push_back(*col);
+			}
+
+			return mergeCollisions(collisions);
+		}
+
+		static std::optional<Collision> collideShapeHeightfield(const Shape& shapeA, const Shape& shapeB) {
+			std::optional<Collision> result = collideHeightfieldShape(shapeB, shapeA);
+			if (result) result->invert();
+			return result;
+		}
+
+#else
+		static std::optional<Collision> collideTilemapShape(const Shape& shapeA, const Shape& shapeB) {
+			const Tilemap& a = (const Tilemap&)shapeA;
+
+			std::vector<Collision> collisions;
+			for (const Polytope* rectangle : a.getRectangles(shapeB.getBounds())) {
+				// the rectangle goes first so that the separating axis is cached on the map side
+				std::optional<Collision> col = collide(*rectangle, shapeB);
+				if (!col) continue;
+
+				for (int i = col->contacts.size() - 1; i >= 0; i--) {
+					if (a.isSeam(col->contacts[i], col->normal)) {
+						col->contacts.erase(col->contacts.begin() + i);
+						col->depths.erase(col->depths.begin() + i);
+					}
+				}
+
+				if (!col->contacts.empty()) collisions.push_back(*col);
+			}
+
+			return mergeCollisions(collisions);
+		}
+
+		static std::optional<Collision> collideShapeTilemap(const Shape& shapeA, const Shape& shapeB) {
+			std::optional<Collision> result = collideTilemapShape(shapeB, shapeA);
+			if (result) result->invert();
+			return result;
+		}
+#endif
+
+		static std::optional<Collision> collideNever(const Shape& shapeA, const Shape& shapeB) {
+			return { };
+		}
+
 		using CollideTest = std::optional<Collision>(*)(const Shape&, const Shape&);
 		constexpr static CollideTest typePairTable[Shape::COUNT][Shape::COUNT] = {
 			{ // Ball
 				collideBallBall, // Ball
-				collideBallPolytope // Polytope
+				collideBallPolytope, // Polytope
+				IF_3D(collideShapeHeightfield, collideShapeTilemap) // Heightfield / Tilemap
 			},
 			{ // Polytope
 				collidePolytopeBall, // Ball
-				collidePolytopePolytope // Polytope
+				collidePolytopePolytope, // Polytope
+				IF_3D(collideShapeHeightfield, collideShapeTilemap) // Heightfield / Tilemap
+			},
+			{ // Heightfield / Tilemap
+				IF_3D(collideHeightfieldShape, collideTilemapShape), // Ball
+				IF_3D(collideHeightfieldShape, collideTilemapShape), // Polytope
+				collideNever // Heightfield / Tilemap
 			}
 		};
 
@@ -231,49 +406,18 @@ API class Detector {
 			return typePairTable[a.type][b.type](a, b);
 		}
 
-		// static std::optional<Collision> collideBodies(const RigidBody& bodyA, const RigidBody& bodyB) {
-		// 	if (!bodyA.bounds.intersects(bodyB.bounds))
-		// 		return { };
-			
-		// 	int aShapes = bodyA.getShapeCount();
-		// 	int bShapes = bodyB.getShapeCount();
-		// 	if (aShapes == 1 && bShapes == 1) {
-		// 		return collide(bodyA.getShape(0), bodyB.getShape(0));
-		// 	} else {
-		// 		std::vector<Collision> collisions { };
-		// 		for (int i = 0; i < aShapes; i++)
-		// 		for (int j = 0; j < bShapes; j++) {
-		// 			std::optional<Collision> col = collide(bodyA.getShape(i), bodyB.getShape(j));
-		// 			if (col) collisions.push_back(*col);
-		// 		}
-		// 		if (!collisions.size()) return { };
-				
-		// 		std::vector<Vector> contacts { };
-		// 		Vector dir { };
-		// 		double penetration = -INFINITY;
-		// 		Collision* best;
-
-		// 		for (int i = 0; i < collisions.size(); i++)
-		// 			dir += collisions[i].normal;
-
-		// 		for (int i = 0; i < collisions.size(); i++) {
-		// 			Collision& col = collisions[i];
-		// 			if (dot(col.normal, dir) < 0.0) continue;
-		// 			contacts.insert(contacts.end(), col.contacts.begin(), col.contacts.end());
-		// 			if (col.penetration > penetration) {
-		// 				penetration = col.penetration;
-		// 				best = &col;
-		// 			}
-		// 		}
-
-		// 		if (!contacts.size()) return { };
-
-		// 		best->contacts = contacts;
-		// 		dir.normalize();
-		// 		best->penetration *= dot(best->normal, dir);
-		// 		best->normal = dir;
-
-		// 		return *best;
-		// 	}
-		// }
+		// one manifold for every collider pair of two bodies
+		static std::optional<Collision> collideBodies(const RigidBody& bodyA, const RigidBody& bodyB) {
+			if (!bodyA.bounds.intersects(bodyB.bounds))
+				return { };
+
+			std::vector<Collision> collisions;
+			bodyA.queryColliders(bodyB, [&](const RigidBody::Collider& a, const RigidBody::Collider& b) {
+				if (!a.bounds.intersects(b.bounds)) return;
+				std::optional<Collision> col = collide(a.cache(), b.cache());
+				if (col) collisions.push_back(*col);
+			});
+
+			return mergeCollisions(collisions);
+		}
 };
\ No newline at end of file
@@ -0,0 +1,371 @@
+#pragma once
+
+#include <vector>
+#include <numeric>
+#include <algorithm>
+
+#include "Resolver.hpp"
+#include "SolverBodies.hpp"
+#include "Constraint/Constraint.hpp"
+
+// solves joints exactly instead of iterating, for groups of joints small enough to be worth factoring.
+// a group is a set of constraints joined by the bodies they move, each constraint taking one or more rows
+// of a system that couples two rows wherever they move the same body. the system is factored as LDLT,
+// eliminating rows fewest neighbors first so the factor stays about as sparse as the joints are.
+// positions take newton steps of that, since the rows turn as the bodies move, while velocities need just the one
+class DirectSolver {
+	private:
+		// two rows that move the same way (as with two joints between the same anchors) make the system singular,
+		// so each row's diagonal gets a touch extra and such rows split their impulses
+		static constexpr double SOFTNESS = 1e-9;
+		static constexpr double POSITION_TOLERANCE = 1e-9;
+		static constexpr int MAX_STEPS = 30;
+		static constexpr int MAX_HALVINGS = 6;
+
+		class Row {
+			public:
+				uint32_t bodies[2];
+				Cross crosses[2];
+				Vector axis;
+		};
+
+		// constraints are stored group by group, each group factored on its own.
+		// a group's rows are numbered constraint by constraint, and eliminated in the order kept for it
+		std::vector<Constraint2*> constraints;
+		std::vector<int> groupEnds;
+		std::vector<int> orders;
+		SolverBodies solverBodies;
+
+		// the group being solved, with rows in elimination order
+		std::vector<Constraint2*> owners;
+		std::vector<Interaction> interactions, saved;
+		std::vector<double> deltas, values;
+		std::vector<Row> rows;
+		std::vector<std::vector<int>> bodyRows;
+		std::vector<std::vector<std::pair<int, double>>> lower, rowEntries;
+		std::vector<double> invPivots, work;
+		std::vector<int> touched;
+		std::vector<uint8_t> marks;
+		std::vector<RigidBody*> groupBodies;
+		std::vector<Transform> poses;
+
+		void gather(const std::vector<Constraint2*>& list) {
+			solverBodies.clear();
+
+			for (Constraint2* con : list) {
+				con->bodyA.solverIndex = SolverBodies::NONE;
+				if (con->dynamic) con->bodyB.solverIndex = SolverBodies::NONE;
+			}
+
+			for (Constraint2* con : list) {
+				con->solver = &solverBodies;
+				con->indexA = solverBodies.add(con->bodyA);
+				if (con->dynamic) con->indexB = solverBodies.add(con->bodyB);
+			}
+		}
+
+		// the constraint each of the group's rows comes from, in row order
+		void setOwners(Constraint2* const* group, int count) {
+			owners.clear();
+			for (int i = 0; i < count; i++)
+				owners.insert(owners.end(), group[i]->getRowCount(), group[i]);
+		}
+
+		// greedy minimum degree over the graph of rows sharing a body, eliminating a row joining its neighbors up
+		void findOrder(std::vector<int>& order) const {
+			int count = owners.size();
+			std::vector<std::vector<int>> neighbors (count);
+			for (int i = 0; i < count; i++)
+				for (int j = 0; j < i; j++) {
+					const Constraint2& a = *owners[i];
+					const Constraint2& b = *owners[j];
+					bool shared = &a == &b ||
+						a.indexA == b.indexA || (b.dynamic && a.indexA == b.indexB) ||
+						(a.dynamic && (a.indexB == b.indexA || (b.dynamic && a.indexB == b.indexB)));
+					if (!shared) continue;
+					neighbors[i].push_back(j);
+					neighbors[j].push_back(i);
+				}
+
+			order.clear();
+			std::vector<uint8_t> eliminated (count);
+			for (int step = 0; step < count; step++) {
+				int best = -1;
+				for (int i = 0; i < count; i++)
+					if (!eliminated[i] && (best < 0 || neighbors[i].size() < neighbors[best].size())) best = i;
+
+				order.push_back(best);
+				eliminated[best] = true;
+				for (int i : neighbors[best]) {
+					erase(neighbors[i], best);
+					for (int j : neighbors[best])
+						if (j != i && std::find(neighbors[i].begin(), neighbors[i].end(), j) == neighbors[i].end())
+							neighbors[i].push_back(j);
+				}
+			}
+		}
+
+		// how much row r's relative velocity changes per unit of impulse along row s, through the body in the given slots
+		double getCoupling(const Row& r, int slotR, const Row& s, int slotS) const {
+			uint32_t body = r.bodies[slotR];
+			double coupling = (
+				solverBodies.invMass[body] * dot(r.axis, s.axis) +
+				dot(solverBodies.invInertia[body] * s.crosses[slotS], r.crosses[slotR])
+			);
+			return slotR == slotS ? coupling : -coupling;
+		}
+
+		// takes the group's interactions as rows, in the order they're eliminated in
+		void setRows(const int* order) {
+			rows.resize(owners.size());
+			for (int k = 0; k < owners.size(); k++) {
+				const Constraint2& con = *owners[order[k]];
+				const Interaction& interaction = interactions[order[k]];
+				Row& row = rows[k];
+				row.bodies[0] = con.indexA;
+				row.bodies[1] = con.dynamic ? con.indexB : SolverBodies::NONE;
+				row.crosses[0] = interaction.crossA;
+				row.crosses[1] = interaction.crossB;
+				row.axis = interaction.axis;
+			}
+		}
+
+		// left-looking: each column gathers the updates from the columns before it that reach its row
+		void factor() {
+			int count = rows.size();
+			bodyRows.resize(solverBodies.bodies.size());
+			for (std::vector<int>& list : bodyRows)
+				list.clear();
+			for (int i = 0; i < count; i++)
+				for (uint32_t body : rows[i].bodies)
+					if (body != SolverBodies::NONE) bodyRows[body].push_back(i);
+
+			lower.resize(count);
+			rowEntries.resize(count);
+			for (int i = 0; i < count; i++) {
+				lower[i].clear();
+				rowEntries[i].clear();
+			}
+			invPivots.assign(count, 0.0);
+			work.assign(count, 0.0);
+			marks.assign(count, false);
+
+			for (int k = 0; k < count; k++) {
+				touched.clear();
+				auto add = [&](int i, double value) {
+					if (!marks[i]) {
+						marks[i] = true;
+						touched.push_back(i);
+					}
+					work[i] += value;
+				};
+
+				const Row& row = rows[k];
+				for (int slot = 0; slot < 2; slot++) {
+					if (row.bodies[slot] == SolverBodies::NONE) continue;
+					for (int i : bodyRows[row.bodies[slot]]) {
+						if (i < k) continue;
+						int other = rows[i].bodies[0] == row.bodies[slot] ? 0 : 1;
+						add(i, getCoupling(rows[i], other, row, slot));
+					}
+				}
+				work[k] *= 1.0 + SOFTNESS;
+
+				for (auto [p, lkp] : rowEntries[k])
+					for (auto [i, lip] : lower[p])
+						if (i >= k) add(i, -lip * lkp / invPivots[p]);
+
+				double pivot = work[k];
+				invPivots[k] = pivot > 0.0 ? 1.0 / pivot : 0.0;
+				for (int i : touched) {
+					if (i > k && invPivots[k] != 0.0) {
+						double value = work[i] * invPivots[k];
+						lower[k].push_back({ i, value });
+						rowEntries[i].push_back({ k, value });
+					}
+					work[i] = 0.0;
+					marks[i] = false;
+				}
+			}
+		}
+
+		// the impulses along each row that cancel the deltas, taken in row order and given back in row order
+		void substitute(const int* order) {
+			int count = deltas.size();
+			values.resize(count);
+			for (int k = 0; k < count; k++)
+				values[k] = deltas[order[k]];
+
+			for (int k = 0; k < count; k++)
+				for (auto [i, value] : lower[k])
+					values[i] -= value * values[k];
+			for (int k = 0; k < count; k++)
+				values[k] *= -invPivots[k];
+			for (int k = count - 1; k >= 0; k--)
+				for (auto [i, value] : lower[k])
+					values[k] -= value * values[i];
+
+			for (int k = 0; k < count; k++)
+				deltas[order[k]] = values[k];
+		}
+
+		// refreshes the group's rows from where the bodies are now, returning the squared length of how far off they are
+		double measure(Constraint2* const* group, int count) {
+			interactions.resize(owners.size());
+			deltas.resize(owners.size());
+			for (int i = 0, row = 0; i < count; row += group[i]->getRowCount(), i++)
+				group[i]->getPositionRows(&interactions[row], &deltas[row]);
+
+			double error = 0.0;
+			for (double delta : deltas)
+				error += delta * delta;
+			return error;
+		}
+
+		template <Derivative D>
+		void apply(const std::vector<Interaction>& along, double scale) {
+			for (int i = 0; i < owners.size(); i++)
+				owners[i]->applyRowImpulse<D>(along[i], deltas[i] * scale);
+		}
+
+		// each newton step is cut in half until it leaves the constraints less far off, since a taut chain of light
+		// links on a heavy body needs huge impulses that only balance out while the links barely turn.
+		// steps go on until the group holds together or stops getting any closer, as joints pulled straight between
+		// fixed ends can't quite be satisfied at all
+		void solvePositions(Constraint2* const* group, int count, const int* order) {
+			groupBodies.clear();
+			marks.assign(solverBodies.bodies.size(), false);
+			for (int i = 0; i < count; i++)
+				for (uint32_t index : { group[i]->indexA, group[i]->dynamic ? group[i]->indexB : SolverBodies::NONE })
+					if (index != SolverBodies::NONE && !marks[index]) {
+						marks[index] = true;
+						groupBodies.push_back(solverBodies.bodies[index]);
+					}
+
+			double error = measure(group, count);
+			for (int n = 0; n < MAX_STEPS && error > POSITION_TOLERANCE * POSITION_TOLERANCE; n++) {
+				setRows(order);
+				factor();
+				substitute(order);
+
+				saved = interactions;
+				std::vector<double> impulses = deltas;
+				poses.clear();
+				for (RigidBody* body : groupBodies)
+					poses.push_back(body->position);
+
+				double scale = 1.0;
+				for (int halving = 0; ; halving++) {
+					deltas = impulses;
+					apply<&RigidBody::position>(saved, scale);
+
+					double next = measure(group, count);
+					if (next < error) {
+						error = next;
+						break;
+					}
+
+					for (int i = 0; i < groupBodies.size(); i++)
+						groupBodies[i]->position = poses[i];
+					if (halving == MAX_HALVINGS) return;
+					scale *= 0.5;
+				}
+			}
+		}
+
+		void solveVelocities(Constraint2* const* group, int count, const int* order) {
+			interactions.resize(owners.size());
+			for (int i = 0, row = 0; i < count; row += group[i]->getRowCount(), i++)
+				group[i]->getVelocityRows(&interactions[row]);
+
+			setRows(order);
+			factor();
+
+			deltas.resize(owners.size());
+			for (int i = 0; i < owners.size(); i++)
+				deltas[i] = owners[i]->getRowVelocity(interactions[i]);
+			substitute(order);
+			apply<&RigidBody::velocity>(interactions, 1.0);
+		}
+
+	public:
+		// takes the constraints of every group with no more than limit rows between them out of the resolver,
+		// leaving the larger groups, and those with constraints that can't be solved exactly, to be iterated as before
+		void take(Resolver<Constraint2>& resolver, int limit) {
+			constraints.clear();
+			groupEnds.clear();
+			orders.clear();
+			if (limit <= 0) return;
+
+			std::vector<Constraint2*> all = resolver.take();
+			gather(all);
+
+			std::vector<uint32_t> parents (solverBodies.bodies.size());
+			std::iota(parents.begin(), parents.end(), 0);
+			auto find = [&](uint32_t index) {
+				while (parents[index] != index)
+					index = parents[index] = parents[parents[index]];
+				return index;
+			};
+			for (Constraint2* con : all)
+				if (con->dynamic) parents[find(con->indexA)] = find(con->indexB);
+
+			// a joint between moving bodies comes as a pair of constraints doing the same job, and solving exactly needs just one
+			std::vector<Constraint2*> sorted = all;
+			std::sort(sorted.begin(), sorted.end());
+			auto isRepeat = [&](const Constraint2* con) {
+				return con->dynamic && con->twin && con->twin->dynamic && std::binary_search(sorted.begin(), sorted.end(), con->twin);
+			};
+
+			std::vector<int> sizes (parents.size());
+			for (Constraint2* con : all) {
+				if (isRepeat(con)) continue;
+				int count = con->getRowCount();
+				sizes[find(con->indexA)] += count ? count : limit + 1;
+			}
+
+			std::vector<std::vector<Constraint2*>> groups (parents.size());
+			for (Constraint2* con : all) {
+				uint32_t root = find(con->indexA);
+				if (sizes[root] > limit) resolver.addConstraint(con);
+				else if (!isRepeat(con)) groups[root].push_back(con);
+			}
+
+			// the joints don't change during the step, so neither does the order their rows are eliminated in
+			std::vector<int> order;
+			for (const std::vector<Constraint2*>& group : groups) {
+				if (group.empty()) continue;
+				constraints.insert(constraints.end(), group.begin(), group.end());
+				groupEnds.push_back(constraints.size());
+
+				setOwners(group.data(), group.size());
+				findOrder(order);
+				orders.insert(orders.end(), order.begin(), order.end());
+			}
+		}
+
+		// the same work as the resolver's passes over positions and then velocities, with each pass exact
+		void solve(double dt) {
+			if (constraints.empty()) return;
+
+			gather(constraints);
+			for (int i = 0, begin = 0, rowBegin = 0; i < groupEnds.size(); begin = groupEnds[i], i++) {
+				setOwners(&constraints[begin], groupEnds[i] - begin);
+				solvePositions(&constraints[begin], groupEnds[i] - begin, &orders[rowBegin]);
+				rowBegin += owners.size();
+			}
+
+			for (Constraint2* con : constraints) {
+				con->recomputeVelocity(dt);
+				con->prestep(dt);
+			}
+
+			gather(constraints);
+			for (int i = 0, begin = 0, rowBegin = 0; i < groupEnds.size(); begin = groupEnds[i], i++) {
+				setOwners(&constraints[begin], groupEnds[i] - begin);
+				solveVelocities(&constraints[begin], groupEnds[i] - begin, &orders[rowBegin]);
+				rowBegin += owners.size();
+			}
+			solverBodies.scatter();
+		}
+};
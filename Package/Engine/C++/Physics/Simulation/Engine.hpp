@@ -1,20 +1,29 @@
 #pragma once
 
+#include <array>
 #include <algorithm>
+#include <numeric>
+
+#include "../../Util/Pool.hpp"
 
 #include "Detector.hpp"
 #include "Resolver.hpp"
+#include "Island.hpp"
 #include "SpatialHash.hpp"
+#include "ParticleMesh.hpp"
+#include "Articulation.hpp"
 #include "Constraint/ContactConstraint.hpp"
 #include "ConstraintDescriptor.hpp"
 
 API_IMPORT void onCollide(const RigidBody&, const RigidBody&, const Vector&, const std::vector<Vector>&, bool, bool);
+API_IMPORT void onSleep(const RigidBody&);
+API_IMPORT void onWake(const RigidBody&);
 
 class Engine;
 
 API class Engine {
 	private:
-		using CollisionPair = std::pair<RigidBody::Collider*, std::vector<RigidBody::Collider*>>;
+		using CollisionPair = Island::CollisionPair;
 
 		static constexpr double CONSTRAINT_IMPROVEMENT_THRESHOLD = 0.1;
 		static constexpr int CONSTRAINT_CONFUSION_THRESHOLD = 4;
@@ -22,29 +31,193 @@ API class Engine {
 		static constexpr int CONSTRAINT_ITERATIONS_THRESHOLD = 100;
 		static constexpr double CONSTRAINT_ERROR_THRESHOLD = 1.0;
 		static constexpr double COLLISION_SLOP = 0.5;
+		static constexpr double SLEEP_VELOCITY = 0.05;
+		static constexpr double SLEEP_ANGULAR_VELOCITY = 0.05;
+		static constexpr double SLEEP_DISTANCE = 0.05;
+		static constexpr double SLEEP_ANGLE = 0.02;
+		static constexpr double SLEEP_TIME = 30.0;
 		
 		std::vector<std::unique_ptr<RigidBody>> bodies;
-		std::vector<RigidBody*> simBodies, finalBodies, nonFinalBodies, dynBodies;
+		std::vector<RigidBody*> simBodies, finalBodies, nonFinalBodies, dynBodies, sleepingBodies;
+		std::vector<RigidBody*> kinematicBodies, movedBodies;
+		std::vector<RigidBody*> sleepEvents, wakeEvents;
 		std::vector<std::unique_ptr<ConstraintDescriptor>> constraintDescriptors;
+		std::vector<std::unique_ptr<ParticleMesh>> particleMeshes;
+		std::vector<std::unique_ptr<Articulation>> articulations;
 		std::unordered_map<std::pair<RigidBody*, RigidBody*>, std::pair<bool, bool>> triggerCache;
-		std::unordered_set<std::pair<RigidBody::Collider*, RigidBody::Collider*>> eventsFired;
 		SpatialHash staticHash, dynamicHash;
 		bool staticHashBroken = true;
+		IslandSet islandSet;
+		std::vector<RigidBody*> slots;
+		std::vector<int> freeSlots, releasedSlots;
+		std::vector<int> scratch;
+		std::array<Pool<ContactConstraint>, ThreadPool::MAX_THREADS> contactPools;
 		double collisionSlop;
+		Vector lastGravity;
+
+		void link(ConstraintDescriptor* desc) {
+			RigidBody& a = desc->a.body;
+			RigidBody& b = desc->b.body;
+			if (a.index >= 0 && b.index >= 0 && a.getDynamic() && b.getDynamic())
+				islandSet.unite(a.index, b.index);
+		}
+
+		void unlink(RigidBody& body) {
+			if (body.index >= 0) islandSet.markSplit(body.index);
+		}
+
+		void link(RigidBody* body) {
+			for (ConstraintDescriptor* desc : body->constraintDescriptors)
+				link(desc);
+			for (RigidBody* other : body->touching)
+				if (body->getDynamic() && other->getDynamic())
+					islandSet.unite(body->index, other->index);
+			if (body->articulation)
+				link(*body->articulation);
+		}
+
+		void link(Articulation& articulation) {
+			RigidBody* lead = articulation.getLead();
+			for (RigidBody* link : articulation.getLinks())
+				if (link->articulation == &articulation && link->index >= 0 && lead->index >= 0)
+					islandSet.unite(link->index, lead->index);
+		}
+
+		void addSimulated(RigidBody* body) {
+			body->beforeSimulation();
+
+			// joints only join islands while both ends are dynamic
+			bool dynamic = body->getDynamic();
+			if (dynamic != body->linkedDynamic) {
+				body->linkedDynamic = dynamic;
+				if (dynamic) link(body);
+				else unlink(*body);
+			}
+
+			// kinematic bodies live in the static hash, which has to be rebuilt whenever one joins or leaves it
+			if (body->getKinematic() != body->hashedKinematic) {
+				body->hashedKinematic = body->getKinematic();
+				staticHashBroken = true;
+			}
+
+			simBodies.push_back(body);
+			if (body->getKinematic()) kinematicBodies.push_back(body);
+			else (body->finalized ? finalBodies : nonFinalBodies).push_back(body);
+			if (body->getDynamic())
+				dynBodies.push_back(body);
+		}
+
+		// wakes everything that fell asleep along with the body, returning those bodies
+		std::vector<RigidBody*> wakeGroup(RigidBody* body) {
+			std::vector<RigidBody*> group = *body->sleepGroup;
+			for (RigidBody* member : group) {
+				member->sleepGroup.reset();
+				member->sleepTime = 0.0;
+				member->wakeRequested = false;
+				wakeEvents.push_back(member);
+			}
+
+			staticHashBroken = true;
+			return group;
+		}
+
+		// sleeping bodies only wake from what touches them, so whatever changes under them has to wake them itself
+		void wakeAround(const std::vector<AABB>& disturbed) {
+			if (disturbed.empty()) return;
+			for (const auto& body : bodies) {
+				if (!body->getSleeping()) continue;
+				for (const AABB& bounds : disturbed)
+					if (body->bounds.intersects(bounds)) {
+						wakeGroup(body.get());
+						break;
+					}
+			}
+		}
+
+		// static bodies moved, changed or edited since the last step, where they were and where they now are
+		std::vector<AABB> getDisturbedBounds() {
+			std::vector<AABB> disturbed;
+			for (const auto& body : bodies) {
+				if (!body->simulated || body->getDynamic()) continue;
+				if (!body->getKinematic() && body->takeDisturbance()) {
+					disturbed.push_back(body->bounds);
+					body->beforeSimulation();
+					disturbed.push_back(body->bounds);
+				}
+				for (RigidBody::Collider& collider : body->colliders)
+					if (std::optional<AABB> edits = collider.takeEdits())
+						disturbed.push_back(*edits);
+			}
+			return disturbed;
+		}
+
+		void wakeGroupDuringStep(RigidBody* body, Resolver<Constraint2>* constraints = nullptr) {
+			for (RigidBody* member : wakeGroup(body)) {
+				if (!member->simulated) continue;
+				addSimulated(member);
+				if (constraints && member->getDynamic())
+					for (ConstraintDescriptor* con : member->constraintDescriptors)
+						constraints->addConstraint(tryConstraint(*member, *con));
+			}
+		}
 
 		void beforeSimulation() {
 			dynBodies.clear();
 			simBodies.clear();
 			finalBodies.clear();
 			nonFinalBodies.clear();
+			kinematicBodies.clear();
+			sleepingBodies.clear();
+
+			for (const auto& body : bodies)
+				if (body->getSleeping() && body->simulated && body->shouldWake())
+					wakeGroup(body.get());
+			wakeAround(getDisturbedBounds());
+
+			// everything rests against the old gravity
+			if (!(gravity == lastGravity)) {
+				lastGravity = gravity;
+				for (const auto& body : bodies)
+					if (body->getSleeping()) wakeGroup(body.get());
+			}
+
 			for (const auto& body : bodies) {
 				if (!body->simulated) continue;
-				body->beforeSimulation();
-				simBodies.push_back(body.get());
-				(body->finalized ? finalBodies : nonFinalBodies).push_back(body.get());
-				if (body->getDynamic())
-					dynBodies.push_back(body.get());
+				if (body->getSleeping()) sleepingBodies.push_back(body.get());
+				else addSimulated(body.get());
 			}
+
+			// joints can't hold a sleeping body to an awake one
+			for (int i = 0; i < dynBodies.size(); i++)
+				for (ConstraintDescriptor* desc : dynBodies[i]->constraintDescriptors)
+					for (RigidBody* other : { &desc->a.body, &desc->b.body })
+						if (other->getSleeping())
+							wakeGroupDuringStep(other);
+
+			// nor can an articulation be partly asleep. links may have been added since it last linked them
+			for (const auto& articulation : articulations) {
+				if (!articulation->getLead()) continue;
+				link(*articulation);
+
+				bool awake = false;
+				for (RigidBody* link : articulation->getLinks())
+					awake = awake || (link->articulation == articulation.get() && !link->getSleeping());
+				if (!awake) continue;
+
+				for (RigidBody* link : articulation->getLinks())
+					if (link->articulation == articulation.get() && link->getSleeping())
+						wakeGroupDuringStep(link);
+			}
+
+			stats.count("awake bodies", dynBodies.size());
+			stats.count("sleeping bodies", sleepingBodies.size());
+		}
+
+		// kinematic bodies go straight to their targets, keeping the velocity that took them there for contacts and joints
+		void moveKinematicBodies(double deltaTime) {
+			movedBodies.clear();
+			for (RigidBody* body : kinematicBodies)
+				if (body->advance(deltaTime)) movedBodies.push_back(body);
 		}
 
 		void afterSimulation() {
@@ -52,18 +225,25 @@ API class Engine {
 				body->afterSimulation();
 		}
 
-		void applyForces(double dt) {
+		void applyForces(Island& island, double dt) {
 			double dragFactor = std::pow(1.0 - drag, dt);
 			Vector scaledGravity = gravity * dt;
-			for (RigidBody* body : dynBodies) {
+			for (RigidBody* body : island.bodies) {
+				if (body->articulation) continue;
 				if (body->gravity) body->velocity.linear += scaledGravity;
 				if (body->drag) body->velocity *= dragFactor;
 			}
+
+			for (Articulation* articulation : island.articulations)
+				articulation->applyForces(gravity, drag, dt);
 		}
 		
-		void integrate(double dt) {
-			for (RigidBody* body : dynBodies)
-				body->integrate(dt);
+		void integrate(Island& island, double dt) {
+			for (RigidBody* body : island.bodies)
+				if (!body->articulation) body->integrate(dt);
+
+			for (Articulation* articulation : island.articulations)
+				articulation->integrate(dt);
 		}
 
 		void sortBodies(bool highToLow) {
@@ -80,98 +260,135 @@ API class Engine {
 
 			if (a.isStatic) return nullptr;
 
-			return desc.makeConstraint(b.isDynamic(), a, b);
+			return desc.getConstraint(b.isDynamic(), swap);
 		}
 
-		void exploreIsland(RigidBody* body, int island, std::unordered_map<RigidBody*, int>& map) {
-			if (map.count(body)) return;
-
-			map.emplace(std::make_pair(body, island));
+		// attempts to solve position, until various conditions occur that suggest convergence has failed.
+		// returns the number of passes made
+		int presolve(Resolver<Constraint2>& resolver, double dt) {
+			double lastError = INFINITY;
+			int confusion = 0;
 
-			for (ConstraintDescriptor* desc : body->constraintDescriptors) {
-				bool swap = body != &desc->a.body;
-				RigidBody* other = swap ? &desc->a.body : &desc->b.body;
-				bool dynamic = swap ? desc->b.isDynamic() : desc->a.isDynamic();
-				if (dynamic) exploreIsland(other, island, map);
+			int i = 0;
+			for (; i < CONSTRAINT_ITERATIONS_THRESHOLD; i++) {
+				double error = resolver.getError();
+				if (error < CONSTRAINT_ERROR_THRESHOLD) break;
+				if (error > lastError - CONSTRAINT_IMPROVEMENT_THRESHOLD) {
+					confusion++;
+					if (confusion > CONSTRAINT_CONFUSION_THRESHOLD)
+						break;
+				}
+				lastError = error;
+				resolver.solve<&Constraint::solvePosition>(dt, CONSTRAINT_BATCH_SIZE);
 			}
+
+			return i;
 		}
 
+		// each island converges on its own, so a struggling one doesn't keep the rest iterating
 		Resolver<Constraint2> getConstraintResolver(double dt) {
 			sortBodies(true);
 
 			Resolver<Constraint2> resolver;
+			resolver.parallel = parallel;
+
+			std::vector<std::unique_ptr<Island>> islands;
+			scratch.assign(slots.size(), -1);
 			for (RigidBody* body : dynBodies)
-				for (ConstraintDescriptor* con : body->constraintDescriptors)
-					resolver.addConstraint(tryConstraint(*body, *con));
-
-			int islandCount = 0;
-			{ // group the bodies into islands
-				std::unordered_map<RigidBody*, int> map;
-				for (RigidBody* body : simBodies) {
-					if (body->constraintDescriptors.size() > 0 && !map.count(body)) {
-						exploreIsland(body, islandCount, map);
-						islandCount++;
+				for (ConstraintDescriptor* con : body->constraintDescriptors) {
+					Constraint2* constraint = tryConstraint(*body, *con);
+					if (!constraint) continue;
+
+					int& island = scratch[islandSet.find(body->index)];
+					if (island < 0) {
+						island = islands.size();
+						islands.push_back(std::make_unique<Island>(parallel ? rng.split() : rng));
+						islands.back()->constraints.parallel = parallel;
+						if (!parallel) islands.back()->constraints.random = &rng;
 					}
+					islands[island]->constraints.addConstraint(constraint);
 				}
-			}
 
-			// attempt to solve position, until various conditions
-			// occur that suggest convergence has failed
-			double lastError = INFINITY;
-			double error;
-			int confusion = 0;
-			double errorThreshold = CONSTRAINT_ERROR_THRESHOLD * islandCount;
+			std::vector<int> passes (islands.size());
+			// small steps keep joints soft, so they aren't solved ahead of the step
+			auto presolveIsland = [&](int i) {
+				passes[i] = smallSteps ? 0 : presolve(islands[i]->constraints, dt);
+			};
 
-			int i = 0;
-			for (; i < CONSTRAINT_ITERATIONS_THRESHOLD; i++) {
-				error = resolver.getError();
-				if (error < errorThreshold) break;
-				if (error > lastError - CONSTRAINT_IMPROVEMENT_THRESHOLD) {
-					confusion++;
-					if (confusion > CONSTRAINT_CONFUSION_THRESHOLD)
-						break;
-				}
-				lastError = error;
-				resolver.solve<&Constraint::solvePosition>(dt, CONSTRAINT_BATCH_SIZE);
+			if (parallel) threadPool.forEach(islands.size(), presolveIsland);
+			else for (int i = 0; i < islands.size(); i++) presolveIsland(i);
+
+			for (int i = 0; i < islands.size(); i++) {
+				stats.count("presolve passes", passes[i]);
+				islands[i]->constraints.distribute([&](Constraint2& con) -> Resolver<Constraint2>& {
+					return resolver;
+				});
 			}
 
 			return resolver;
 		}
 		
-		void solveConstraints(Resolver<Constraint2>& resolver, double dt) {
+		void solveConstraints(Island& island, double dt) {
+			Resolver<Constraint2>& resolver = island.constraints;
 			resolver.solve<&Constraint::solvePosition>(dt, constraintIterations);
 			resolver.solve<&Constraint2::recomputeVelocity>(dt);
-			resolver.solve<&Constraint::solveVelocity>(dt);
+			resolver.prestep(dt);
+			resolver.solveVelocities<&Constraint::solveVelocity>(dt);
+			island.directConstraints.solve(dt);
 		}
 		
-		std::vector<CollisionPair> getCollisionPairs(double dt) {
+		std::vector<CollisionPair> getCollisionPairs(Resolver<Constraint2>& constraints, double dt) {
 			sortBodies(false);
 
+			// sleeping bodies don't move, so they are hashed like static ones. kinematic bodies do,
+			// but seldom far, so they are refiled in place rather than having the whole hash rebuilt
 			if (staticHashBroken) {
 				staticHashBroken = false;
-				staticHash.build(finalBodies, dt);
+				std::vector<RigidBody*> staticBodies = finalBodies;
+				staticBodies.insert(staticBodies.end(), kinematicBodies.begin(), kinematicBodies.end());
+				for (RigidBody* body : sleepingBodies)
+					if (body->getSleeping()) staticBodies.push_back(body);
+				staticHash.build(staticBodies, dt);
+			} else {
+				for (RigidBody* body : movedBodies)
+					staticHash.move(*body);
 			}
 
+			// nothing awake moves sleeping bodies but kinematic ones
+			std::vector<RigidBody*> swept;
+			for (RigidBody* body : movedBodies) {
+				if (sleepingBodies.empty()) break;
+				if (!body->canCollide || body->colliders.empty()) continue;
+
+				swept.clear();
+				staticHash.query(*body, swept);
+				for (RigidBody* other : swept)
+					if (other->getSleeping() && staticHash.overlaps(*body, *other))
+						wakeGroupDuringStep(other, &constraints);
+			}
 
 			dynamicHash.build(nonFinalBodies, dt);
 			std::vector<CollisionPair> collisionPairs;
-			for (RigidBody* body : dynBodies)
-				if (body->canCollide)
-					for (RigidBody::Collider& collider : body->colliders) {
-						std::vector<RigidBody::Collider*> others;
-						dynamicHash.query(collider, others);
-						staticHash.query(collider, others);
-						collisionPairs.emplace_back(&collider, others);
-					}
+			for (int i = 0; i < dynBodies.size(); i++) {
+				RigidBody* body = dynBodies[i];
+				if (!body->canCollide || body->colliders.empty()) continue;
+
+				std::vector<RigidBody*> others;
+				dynamicHash.query(*body, others);
+				staticHash.query(*body, others);
+
+				// anything an awake body might touch wakes up, and is queried in turn
+				for (RigidBody* other : others)
+					if (other->getSleeping() && staticHash.overlaps(*body, *other))
+						wakeGroupDuringStep(other, &constraints);
+
+				collisionPairs.emplace_back(body, others);
+			}
 			
 			return collisionPairs;
 		}
 
-		bool triggerCollision(RigidBody::Collider* a, RigidBody::Collider* b, const Collision& col) {
-			RigidBody* bodyA = a->body;
-			RigidBody* bodyB = b->body;
-
-			auto collisionKey = a < b ? std::make_pair(a, b) : std::make_pair(b, a);
+		std::pair<bool, bool> getTrigger(RigidBody* bodyA, RigidBody* bodyB) {
 			auto triggerKey = std::make_pair(bodyA, bodyB);
 
 			if (!triggerCache.count(triggerKey)) {
@@ -182,45 +399,314 @@ API class Engine {
 				triggerCache[{ bodyB, bodyA }] = { isTriggerB, isTriggerA };
 			}
 
-			auto trigger = triggerCache.at(triggerKey);
+			return triggerCache.at(triggerKey);
+		}
+
+		bool triggerCollision(Island& island, RigidBody* bodyA, RigidBody* bodyB, const Collision& col) {
+			auto collisionKey = bodyA < bodyB ? std::make_pair(bodyA, bodyB) : std::make_pair(bodyB, bodyA);
+			auto trigger = getTrigger(bodyA, bodyB);
 
-			if (!eventsFired.count(collisionKey)) {
-				eventsFired.insert(collisionKey);
-				onCollide(*bodyA, *bodyB, col.normal, col.contacts, trigger.first, trigger.second);
+			if (!island.eventsFired.count(collisionKey)) {
+				island.eventsFired.insert(collisionKey);
+				island.events.push_back({ bodyA, bodyB, col.normal, col.contacts, trigger.first, trigger.second });
 			}
 
 			return trigger.first || trigger.second;
 		}
 		
-		ContactConstraint* tryCollision(RigidBody::Collider& a, RigidBody::Collider& b, double dt) {
-			if (!a.bounds.intersects(b.bounds)) return nullptr;
+		ContactConstraint* tryCollision(Island& island, Pool<ContactConstraint>& pool, RigidBody& a, RigidBody& b, double dt) {
+			// small steps push both bodies of a dynamic pair at once, so one ordering is enough
+			if (smallSteps && b.getDynamic() && &b < &a) return nullptr;
 
-			const Shape& shapeA = a.cache();
-			const Shape& shapeB = b.cache();
-			std::optional<Collision> col = Detector::collide(shapeA, shapeB);
+			std::optional<Collision> col = Detector::collideBodies(a, b);
 			
-			if (!col || triggerCollision(&a, &b, *col)) return nullptr;
+			if (!col || col->contacts.empty() || triggerCollision(island, &a, &b, *col)) return nullptr;
 
 			col->penetration -= collisionSlop;
+			for (double& depth : col->depths)
+				depth -= collisionSlop;
 
-			bool dynamic = b.body->getDynamic() && !b.body->prohibited.has(col->normal);
-			if (!dynamic) a.body->prohibited.add(col->normal);
+			// small steps only ever soften overlap, so nothing is resolved up front or held still
+			if (smallSteps) return pool.make(b.getDynamic(), a, b, *col, coneFriction, contactCompliance);
+
+			bool dynamic = b.getDynamic() && !b.prohibited.has(col->normal);
+			if (!dynamic) a.prohibited.add(col->normal);
 			
-			ContactConstraint* constraint = new ContactConstraint(dynamic, *a.body, *b.body, *col);
+			ContactConstraint* constraint = pool.make(dynamic, a, b, *col, coneFriction);
 			constraint->solvePosition(dt);
 			return constraint;
 		}
 
-		void solveCollisions(const std::vector<CollisionPair>& collisionPairs, double dt) {
-			for (RigidBody* body : dynBodies)
+		void solveCollisions(Island& island, double dt) {
+			for (RigidBody* body : island.bodies)
 				body->prohibited.clear();
 			
+			// islands only nest on a thread while it waits for its own work, so their pool use nests too
+			Pool<ContactConstraint>& pool = contactPools[ThreadPool::getThreadIndex()];
+			int mark = pool.mark();
+
 			Resolver<ContactConstraint> resolver;
-			for (const auto& [collider, toCollide] : collisionPairs)
-				for (RigidBody::Collider* other : toCollide)
-					resolver.addConstraint(tryCollision(*collider, *other, dt));
+			resolver.parallel = parallel;
+			resolver.shockPropagation = shockPropagation;
+			resolver.random = &island.random;
+			for (Articulation* articulation : island.articulations)
+				articulation->lendMatter();
+			for (const auto& [body, toCollide] : island.collisionPairs)
+				for (RigidBody* other : toCollide)
+					resolver.addConstraint(tryCollision(island, pool, *body, *other, dt));
+
+			// pushing a link out drags the rest of its articulation along. that is kept as motion,
+			// which friction can then take back, or articulations would creep sideways wherever they rest
+			for (Articulation* articulation : island.articulations)
+				articulation->absorbPositions(dt, true);
+
+			// articulated links are solved as free bodies, so their articulations take up what every pass
+			// did to them before the next one, which then sees the whole articulation move
+			if (island.articulations.empty()) resolver.solveVelocities<&ContactConstraint::solveVelocity>(dt, contactIterations);
+			else for (int i = 0; i < contactIterations; i++) {
+				resolver.shockPropagation = shockPropagation && i == contactIterations - 1;
+				resolver.solveVelocities<&ContactConstraint::solveVelocity>(dt, 1);
+				for (Articulation* articulation : island.articulations)
+					articulation->absorbVelocities();
+			}
+			for (Articulation* articulation : island.articulations)
+				articulation->returnMatter();
+			pool.release(mark);
+		}
+
+		// keeps the persistent islands in line with this step's possible contacts,
+		// then groups the step's dynamic bodies by island.
+		// bodies in different groups can't affect each other until the next step
+		std::vector<std::vector<RigidBody*>> getGroups(const std::vector<CollisionPair>& collisionPairs) {
+			auto setTouching = [&](RigidBody* body, std::vector<RigidBody*> touching) {
+				std::erase_if(touching, [](RigidBody* other) { return !other->getDynamic(); });
+				std::sort(touching.begin(), touching.end());
+				for (RigidBody* other : body->touching)
+					if (!std::binary_search(touching.begin(), touching.end(), other)) {
+						unlink(*body);
+						break;
+					}
+				body->touching = std::move(touching);
+			};
 
-			resolver.solve<&ContactConstraint::solveVelocity>(dt, contactIterations);
+			for (const auto& [body, toCollide] : collisionPairs)
+				setTouching(body, toCollide);
+			for (RigidBody* body : dynBodies)
+				if (!body->canCollide || body->colliders.empty())
+					setTouching(body, { });
+
+			if (islandSet.getSplitPending()) {
+				std::vector<int> reset = islandSet.split();
+				for (int index : reset)
+					if (slots[index]) link(slots[index]);
+
+				// removed indices can't be reused while anything may still link through them
+				freeSlots.insert(freeSlots.end(), releasedSlots.begin(), releasedSlots.end());
+				releasedSlots.clear();
+			}
+
+			for (RigidBody* body : dynBodies)
+				for (RigidBody* other : body->touching)
+					islandSet.unite(body->index, other->index);
+
+			std::vector<std::vector<RigidBody*>> groups;
+			scratch.assign(slots.size(), -1);
+			for (RigidBody* body : dynBodies) {
+				int& group = scratch[islandSet.find(body->index)];
+				if (group < 0) {
+					group = groups.size();
+					groups.emplace_back();
+				}
+				groups[group].push_back(body);
+			}
+
+			stats.count("islands", groups.size());
+
+			return groups;
+		}
+
+		bool isAwake(const Articulation& articulation) const {
+			RigidBody* lead = articulation.getLead();
+			return lead && lead->getDynamic() && lead->simulated && !lead->getSleeping();
+		}
+
+		// one island per group, or a single island drawing on the global random stream without parallel
+		std::vector<std::unique_ptr<Island>> getIslands(
+			const std::vector<std::vector<RigidBody*>>& groups,
+			Resolver<Constraint2>& constraints, std::vector<CollisionPair>& collisionPairs
+		) {
+			std::vector<std::unique_ptr<Island>> islands;
+
+			if (!parallel) {
+				Island& island = *islands.emplace_back(std::make_unique<Island>(rng));
+				island.bodies = dynBodies;
+				for (const auto& articulation : articulations)
+					if (isAwake(*articulation))
+						island.articulations.push_back(articulation.get());
+				island.collisionPairs = std::move(collisionPairs);
+				constraints.distribute([&](Constraint2& con) -> Resolver<Constraint2>& {
+					return island.constraints;
+				});
+				return islands;
+			}
+
+			std::vector<Island*> islandOf (slots.size());
+			for (const std::vector<RigidBody*>& group : groups) {
+				Island& island = *islands.emplace_back(std::make_unique<Island>(rng.split()));
+				island.bodies = group;
+				island.constraints.parallel = true;
+				for (RigidBody* body : group)
+					islandOf[body->index] = &island;
+			}
+
+			// islands may not touch shared state, so triggers and static shapes are resolved up front
+			for (const auto& [body, toCollide] : collisionPairs)
+				for (RigidBody* other : toCollide) {
+					getTrigger(body, other);
+					if (!other->getDynamic())
+						for (const RigidBody::Collider& collider : other->colliders)
+							collider.cache();
+				}
+
+			for (CollisionPair& pair : collisionPairs)
+				islandOf[pair.first->index]->collisionPairs.push_back(std::move(pair));
+
+			for (const auto& articulation : articulations)
+				if (isAwake(*articulation))
+					islandOf[articulation->getLead()->index]->articulations.push_back(articulation.get());
+
+			constraints.distribute([&](Constraint2& con) -> Resolver<Constraint2>& {
+				return islandOf[con.bodyA.index]->constraints;
+			});
+
+			return islands;
+		}
+
+		static double angle(const Orientation& orientation) {
+			auto rotation = orientation.getRotation();
+			return IF_3D(rotation.mag(), std::abs(rotation));
+		}
+
+		// contact jitter keeps velocities from ever settling at zero, so a body also counts as resting
+		// while it stays near where its sleep timer started (kept in sleepPosition until it sleeps).
+		// the tests are written so that NaN fails them, since sleeping would freeze a blown up body in place
+		bool isResting(const RigidBody& body) const {
+			if (!(body.velocity.linear.sqrMag() <= SLEEP_VELOCITY * SLEEP_VELOCITY)) return false;
+			if (!(angle(body.velocity.orientation) <= SLEEP_ANGULAR_VELOCITY)) return false;
+			if (!std::isfinite(body.position.linear.sqrMag()) || !std::isfinite(angle(body.position.orientation))) return false;
+			if (body.sleepTime == 0.0) return true;
+			if (!((body.position.linear - body.sleepPosition.linear).sqrMag() <= SLEEP_DISTANCE * SLEEP_DISTANCE)) return false;
+			return angle(body.position.orientation + -body.sleepPosition.orientation) < SLEEP_ANGLE;
+		}
+
+		// groups that have all been resting long enough fall asleep together
+		void updateSleep(const std::vector<std::vector<RigidBody*>>& groups, double dt) {
+			for (const std::vector<RigidBody*>& group : groups) {
+				bool asleep = allowSleeping;
+				for (RigidBody* body : group) {
+					if (body->canSleep && isResting(*body)) {
+						if (body->sleepTime == 0.0) body->sleepPosition = body->position;
+						body->sleepTime += dt;
+					} else body->sleepTime = 0.0;
+					if (body->sleepTime < SLEEP_TIME) asleep = false;
+				}
+
+				if (!asleep) continue;
+
+				auto sleepGroup = std::make_shared<std::vector<RigidBody*>>(group);
+				for (RigidBody* body : group) {
+					body->sleepGroup = sleepGroup;
+					body->sleepPosition = body->position;
+					body->velocity = { };
+					body->wakeRequested = false;
+					sleepEvents.push_back(body);
+				}
+
+				staticHashBroken = true;
+			}
+		}
+
+		// the pairs found for the step have their contacts found afresh each substep, since a tumbling body
+		// brings new points into contact long before the step is over, and those would otherwise sink unchecked
+		void simulateSmallSteps(Island& island, double dt) {
+			Pool<ContactConstraint>& pool = contactPools[ThreadPool::getThreadIndex()];
+
+			Resolver<ContactConstraint> resolver;
+			resolver.parallel = parallel;
+
+			for (RigidBody* body : island.bodies)
+				body->stepStart = body->position;
+
+			// every substep is solved in the same order, since a new one each time shakes stacks that would otherwise settle
+			Random* random = island.constraints.random;
+			Random order = random->split();
+			for (int i = 0; i < iterations; i++) {
+				Random substepOrder = order;
+				island.constraints.random = resolver.random = &substepOrder;
+				int mark = pool.mark();
+				applyForces(island, dt);
+				integrate(island, dt);
+
+				resolver.clear();
+				for (const auto& [body, toCollide] : island.collisionPairs)
+					for (RigidBody* other : toCollide)
+						resolver.addConstraint(tryCollision(island, pool, *body, *other, dt));
+
+				island.constraints.solve<&Constraint::solveCompliantPosition>(dt);
+				resolver.solve<&ContactConstraint::solveCompliantPosition>(dt);
+				for (RigidBody* body : island.bodies)
+					if (!body->articulation) body->recomputeVelocity(dt);
+				for (Articulation* articulation : island.articulations) {
+					articulation->recomputeVelocities(dt);
+					articulation->absorbPositions(dt, true);
+				}
+				resolver.solveVelocities<&ContactConstraint::solveCompliantVelocity>(dt);
+				for (Articulation* articulation : island.articulations)
+					articulation->absorbVelocities();
+				pool.release(mark);
+			}
+			island.constraints.random = random;
+			for (Articulation* articulation : island.articulations)
+				articulation->returnMatter();
+		}
+
+		// after the islands, against the bodies where they ended up. they don't push back,
+		// so every mesh can be simulated on its own however many bodies it touches
+		void simulateParticleMeshes(double deltaTime) {
+			std::vector<std::vector<RigidBody*>> nearby;
+			for (const auto& mesh : particleMeshes) {
+				AABB bounds = mesh->getSweptBounds(gravity, deltaTime);
+				nearby.emplace_back();
+				if (!mesh->canCollide) continue;
+				staticHash.query(bounds, nearby.back());
+				dynamicHash.query(bounds, nearby.back());
+				for (RigidBody* body : nearby.back())
+					for (const RigidBody::Collider& collider : body->colliders)
+						collider.cache();
+			}
+
+			for (int i = 0; i < particleMeshes.size(); i++)
+				particleMeshes[i]->simulate(nearby[i], gravity, drag, deltaTime, parallel);
+		}
+
+		void simulate(Island& island, double deltaTime) {
+			for (Articulation* articulation : island.articulations)
+				articulation->sync();
+
+			double dt = deltaTime / iterations;
+			if (smallSteps) return simulateSmallSteps(island, dt);
+
+			island.directConstraints.take(island.constraints, directRowLimit);
+			for (int i = 0; i < iterations; i++) {
+				applyForces(island, dt);
+				integrate(island, dt);
+				solveConstraints(island, dt);
+				for (Articulation* articulation : island.articulations) {
+					articulation->absorbVelocities();
+					articulation->absorbPositions(dt, false);
+				}
+				solveCollisions(island, dt);
+			}
 		}
 
 	public:
@@ -228,12 +714,40 @@ API class Engine {
 		API double drag = 0.005;
 		API int constraintIterations = 4;
 		API int contactIterations = 4;
+		// joints in groups of no more than this many rows are solved exactly each substep rather than iterated,
+		// which holds stiff chains of uneven masses together. a length constraint is one row and the other joints
+		// up to six. joints with limits or motors are always iterated, and zero iterates them all
+		API int directRowLimit = 64;
 		API int iterations = 10;
+		API bool parallel = false;
+		// bounds friction by a circle around each contact rather than a box along its tangents
+		API bool coneFriction = true;
+		// after the contact iterations, carries support up through stacks in a single bottom-up pass,
+		// so tall stacks settle without needing more iterations
+		API bool shockPropagation = false;
+		// XPBD in place of the usual pipeline: each of the iterations is a small step that projects every joint
+		// and contact once, softened by its compliance, and then takes velocities from how far the bodies moved.
+		// constraintIterations, contactIterations and the options above don't apply, and more iterations are usually wanted
+		API bool smallSteps = false;
+		// how far contacts give per unit of force when taking small steps, zero being rigid
+		API double contactCompliance = 0.0;
+		API bool allowSleeping = true;
 
 		API Engine() { }
 
 		API void addBody(RigidBody* body) {
 			bodies.emplace_back(body);
+
+			if (freeSlots.empty()) {
+				body->index = slots.size();
+				slots.push_back(body);
+			} else {
+				body->index = freeSlots.back();
+				freeSlots.pop_back();
+				slots[body->index] = body;
+			}
+
+			islandSet.add(body->index);
 		}
 
 		API void finalizeBody(RigidBody* body) {
@@ -242,10 +756,28 @@ API class Engine {
 		}
 
 		API void removeBody(RigidBody* body) {
-			if (body->finalized) staticHashBroken = true;
+			if (body->getSleeping()) wakeGroup(body);
+			if (!body->getDynamic()) wakeAround({ body->bounds });
+			std::erase(wakeEvents, body);
+			std::erase(sleepEvents, body);
+			for (const auto& mesh : particleMeshes)
+				mesh->releaseBody(body);
+			std::vector<Articulation*> joined;
+			for (const auto& articulation : articulations)
+				if (articulation->hasLink(body)) joined.push_back(articulation.get());
+			for (Articulation* articulation : joined)
+				removeArticulation(articulation);
+			unlink(*body);
+			for (const auto& other : bodies)
+				std::erase(other->touching, body);
+			if (body->finalized || body->hashedKinematic) staticHashBroken = true;
 			std::vector<ConstraintDescriptor*> descriptors = body->constraintDescriptors;
 			for (ConstraintDescriptor* constraint : descriptors)
 				removeConstraint(constraint);
+			if (body->index >= 0) {
+				slots[body->index] = nullptr;
+				releasedSlots.push_back(body->index);
+			}
 			erase(bodies, body);
 		}
 
@@ -259,9 +791,12 @@ API class Engine {
 		API void addConstraint(ConstraintDescriptor* constraint) {
 			constraintDescriptors.emplace_back(constraint);
 			constraint->add();
+			link(constraint);
 		}
 
 		API void removeConstraint(ConstraintDescriptor* constraint) {
+			unlink(constraint->a.body);
+			unlink(constraint->b.body);
 			constraint->remove();
 			erase(constraintDescriptors, constraint);
 		}
@@ -273,6 +808,55 @@ API class Engine {
 			return result;
 		}
 
+		// its links should already have been added as bodies
+		API void addArticulation(Articulation* articulation) {
+			articulations.emplace_back(articulation);
+		}
+
+		API void removeArticulation(Articulation* articulation) {
+			for (RigidBody* link : articulation->getLinks())
+				if (link->articulation == articulation) unlink(*link);
+			erase(articulations, articulation);
+		}
+
+		API std::vector<Articulation*> getArticulations() const {
+			std::vector<Articulation*> result;
+			for (const auto& articulation : articulations)
+				result.push_back(articulation.get());
+			return result;
+		}
+
+		API void addParticleMesh(ParticleMesh* mesh) {
+			particleMeshes.emplace_back(mesh);
+		}
+
+		API void removeParticleMesh(ParticleMesh* mesh) {
+			erase(particleMeshes, mesh);
+		}
+
+		API std::vector<ParticleMesh*> getParticleMeshes() const {
+			std::vector<ParticleMesh*> result;
+			for (const auto& mesh : particleMeshes)
+				result.push_back(mesh.get());
+			return result;
+		}
+
+		// bodies sharing an island can be linked through joints or contacts, while those in different ones can't
+		API int getIsland(RigidBody* body) {
+			if (body->index < 0) return -1;
+			return islandSet.find(body->index);
+		}
+
+		API std::vector<RigidBody*> getIslandBodies(RigidBody* body) {
+			std::vector<RigidBody*> result;
+			int island = getIsland(body);
+			if (island < 0) return result;
+			for (RigidBody* other : slots)
+				if (other && islandSet.find(other->index) == island)
+					result.push_back(other);
+			return result;
+		}
+
 		API double getKineticEnergy() const {
 			double K = 0;
 			for (RigidBody* body : dynBodies)
@@ -285,22 +869,38 @@ API class Engine {
 			// stats.reset();
 
 			beforeSimulation();
+			moveKinematicBodies(deltaTime);
 
 			collisionSlop = COLLISION_SLOP * gravity.mag();
 
 			triggerCache.clear();
-			eventsFired.clear();
 			
 			Resolver<Constraint2> constraintResolver = getConstraintResolver(deltaTime);
-			std::vector<CollisionPair> collisionPairs = getCollisionPairs(deltaTime);
+			std::vector<CollisionPair> collisionPairs = getCollisionPairs(constraintResolver, deltaTime);
+			std::vector<std::vector<RigidBody*>> groups = getGroups(collisionPairs);
+			std::vector<std::unique_ptr<Island>> islands = getIslands(groups, constraintResolver, collisionPairs);
 			
-			double dt = deltaTime / iterations;
-			for (int i = 0; i < iterations; i++) {
-				applyForces(dt);
-				integrate(dt);
-				solveConstraints(constraintResolver, dt);
-				solveCollisions(collisionPairs, dt);
-			}
+			threadPool.forEach(islands.size(), [&](int i) {
+				simulate(*islands[i], deltaTime);
+			});
+
+			if (!parallel) rng = islands[0]->random;
+
+			simulateParticleMeshes(deltaTime);
+
+			updateSleep(groups, deltaTime);
+
+			// events call back into JS, so they wait until every island is done
+			for (const auto& island : islands)
+				for (const Island::CollisionEvent& event : island->events)
+					onCollide(*event.a, *event.b, event.normal, event.contacts, event.triggerA, event.triggerB);
+
+			for (RigidBody* body : wakeEvents)
+				onWake(*body);
+			for (RigidBody* body : sleepEvents)
+				onSleep(*body);
+			wakeEvents.clear();
+			sleepEvents.clear();
 
 			afterSimulation();
 
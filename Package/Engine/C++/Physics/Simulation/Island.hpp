@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vector>
+#include <cinttypes>
+#include <unordered_set>
+
+#include "Resolver.hpp"
+#include "DirectSolver.hpp"
+#include "Articulation.hpp"
+#include "Constraint/Constraint.hpp"
+
+// dynamic bodies that can only affect each other (or static bodies) during a step,
+// along with everything needed to simulate them independently of every other island
+class Island {
+	public:
+		using CollisionPair = std::pair<RigidBody*, std::vector<RigidBody*>>;
+
+		class CollisionEvent {
+			public:
+				RigidBody* a;
+				RigidBody* b;
+				Vector normal;
+				std::vector<Vector> contacts;
+				bool triggerA, triggerB;
+		};
+
+		std::vector<RigidBody*> bodies;
+		std::vector<Articulation*> articulations;
+		std::vector<CollisionPair> collisionPairs;
+		Resolver<Constraint2> constraints;
+		DirectSolver directConstraints;
+		Random random;
+
+		std::unordered_set<std::pair<RigidBody*, RigidBody*>> eventsFired;
+		std::vector<CollisionEvent> events;
+
+		Island(const Random& _random)
+		: random(_random) {
+			constraints.random = &random;
+		}
+
+		Island(const Island&) = delete;
+};
+
+// disjoint sets over stable body indices that persist between steps.
+// links are only ever added eagerly, while removing one marks its set to be split,
+// which happens lazily by resetting and relinking just the marked sets
+class IslandSet {
+	private:
+		std::vector<int> parents;
+		std::vector<int> sizes;
+		std::vector<uint8_t> broken;
+		bool splitPending = false;
+
+	public:
+		void add(int index) {
+			if (index >= parents.size()) {
+				parents.resize(index + 1);
+				sizes.resize(index + 1);
+				broken.resize(index + 1);
+			}
+
+			parents[index] = index;
+			sizes[index] = 1;
+			broken[index] = false;
+		}
+
+		int find(int index) {
+			while (parents[index] != index)
+				index = parents[index] = parents[parents[index]];
+			return index;
+		}
+
+		void unite(int a, int b) {
+			a = find(a);
+			b = find(b);
+			if (a == b) return;
+			if (sizes[a] < sizes[b]) std::swap(a, b);
+			parents[b] = a;
+			sizes[a] += sizes[b];
+			broken[a] = broken[a] || broken[b];
+		}
+
+		void markSplit(int index) {
+			broken[find(index)] = true;
+			splitPending = true;
+		}
+
+		bool getSplitPending() const {
+			return splitPending;
+		}
+
+		// resets every index in a marked set to a singleton, returning them so they can be relinked
+		std::vector<int> split() {
+			std::vector<int> reset;
+			for (int i = 0; i < parents.size(); i++)
+				if (broken[find(i)]) reset.push_back(i);
+
+			for (int i : reset)
+				add(i);
+
+			splitPending = false;
+			return reset;
+		}
+};
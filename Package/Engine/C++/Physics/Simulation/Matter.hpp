@@ -53,6 +53,7 @@ class Matter {
 		Matter& operator *=(double factor) {
 			mass *= factor;
 			inertia *= factor;
+			if (inverses) computeInverses();
 			return *this;
 		}
 
@@ -71,7 +72,7 @@ class Matter {
 		Matter rotate(const Orientation& orientation) const {
 #if IS_3D
 			Matrix mat = orientation.toMatrix();
-			return { mass, mat.transpose() * inertia * mat };
+			return { mass, mat * inertia * mat.transpose() };
 #else
 			return *this;
 #endif
@@ -98,4 +99,124 @@ class Matter {
 		}
 };
 
-Matter Matter::STATIC { INFINITY, INFINITY };
\ No newline at end of file
+Matter Matter::STATIC { INFINITY, INFINITY };
+
+// matter along its principal axes, from which the inertia at any orientation follows together with its inverse
+// without inverting a matrix. the axes only change with the shapes, so they are found once rather than each substep
+class PrincipalMatter {
+	private:
+#if IS_3D
+		// cyclic jacobi sweeps, which turn a symmetric matrix diagonal in a handful of rotations
+		static void diagonalize(Matrix inertia, Matrix& axes, Vector& moments) {
+			static constexpr int MAX_SWEEPS = 16;
+			static constexpr double EPSILON = 1e-15;
+
+			axes = Matrix();
+			for (int sweep = 0; sweep < MAX_SWEEPS; sweep++) {
+				double off = 0.0, scale = 0.0;
+				for (int r = 0; r < 3; r++)
+				for (int c = 0; c < 3; c++)
+					(r == c ? scale : off) += inertia[r][c] * inertia[r][c];
+				if (off <= EPSILON * EPSILON * scale) break;
+
+				for (int p = 0; p < 2; p++)
+				for (int q = p + 1; q < 3; q++) {
+					if (inertia[p][q] == 0.0) continue;
+					double theta = (inertia[q][q] - inertia[p][p]) / (2.0 * inertia[p][q]);
+					double t = (theta < 0.0 ? -1.0 : 1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+					double c = 1.0 / std::sqrt(t * t + 1.0);
+					double s = t * c;
+
+					Matrix turn;
+					turn[p][p] = turn[q][q] = c;
+					turn[p][q] = s;
+					turn[q][p] = -s;
+					inertia = turn.transpose() * inertia * turn;
+					axes = axes * turn;
+				}
+			}
+
+			for (int i = 0; i < 3; i++)
+				moments[i] = inertia[i][i];
+		}
+#endif
+
+	public:
+		double mass, invMass;
+#if IS_3D
+		Matrix axes;
+#endif
+		Rotation moments, invMoments;
+		
+		PrincipalMatter(const Matter& matter) {
+			mass = matter.mass;
+			invMass = 1.0 / mass;
+#if IS_3D
+			bool finite = true;
+			for (int r = 0; r < 3; r++)
+			for (int c = 0; c < 3; c++)
+				finite &= std::isfinite(matter.inertia[r][c]);
+
+			if (finite) diagonalize(matter.inertia, axes, moments);
+			else {
+				axes = Matrix();
+				for (int i = 0; i < 3; i++)
+					moments[i] = matter.inertia[i][i];
+			}
+
+			for (int i = 0; i < 3; i++)
+				invMoments[i] = 1.0 / moments[i];
+#else
+			moments = matter.inertia;
+			invMoments = 1.0 / moments;
+#endif
+		}
+
+		PrincipalMatter()
+		: PrincipalMatter(Matter()) { }
+
+		// what Matter::rotate gives, with its inverses
+		Matter rotate(const Orientation& orientation) const {
+			Matter result (mass, Inertia(0.0), false);
+			result.invMass = invMass;
+#if IS_3D
+			Matrix turned = orientation.toMatrix() * axes;
+			bool singular = false;
+			for (int i = 0; i < 3; i++)
+				singular |= !std::isfinite(invMoments[i]);
+
+			for (int r = 0; r < 3; r++)
+			for (int c = r; c < 3; c++) {
+				double inertia = 0.0, invInertia = 0.0;
+				for (int k = 0; k < 3; k++) {
+					double product = turned[r][k] * turned[c][k];
+					inertia += product * moments[k];
+					invInertia += product * invMoments[k];
+				}
+				result.inertia[r][c] = result.inertia[c][r] = inertia;
+				result.invInertia[r][c] = result.invInertia[c][r] = invInertia;
+			}
+
+			// degenerate matter is left as the general inverse would leave it
+			if (singular) result.computeInverses();
+#else
+			result.inertia = moments;
+			result.invInertia = invMoments;
+#endif
+			result.inverses = true;
+			return result;
+		}
+
+		// the angular velocity a momentum gives at an orientation, without building the world inverse
+		Rotation getTurning(const Orientation& orientation, const Rotation& momentum) const {
+#if IS_3D
+			Vector local = (-orientation) * momentum;
+			Vector principal = axes.transpose() * local;
+			for (int i = 0; i < 3; i++)
+				principal[i] *= invMoments[i];
+			return orientation * (axes * principal);
+#else
+			return momentum * invMoments;
+#endif
+		}
+};
@@ -0,0 +1,346 @@
+#pragma once
+
+#include <vector>
+#include <bit>
+
+#include "../../Util/ThreadPool.hpp"
+#include "Detector.hpp"
+#include "RigidBody.hpp"
+
+// a rope or cloth, as point masses held together by distance links rather than as bodies joined by constraints.
+// particles are stored field by field and links as index pairs. each substep projects every link once, XPBD style,
+// one color at a time so that no two links being projected together share a particle.
+// particles collide with bodies as small balls, but only ever move themselves out of the way
+API class ParticleMesh {
+	private:
+		static constexpr int MAX_COLORS = 64;
+		static constexpr int BATCH_GRAIN = 64;
+
+		std::vector<Vector> positions, lastPositions, velocities;
+		std::vector<double> invMasses;
+		std::vector<uint8_t> held;
+
+		std::vector<int> linkA, linkB;
+		std::vector<double> lengths;
+		std::vector<std::vector<int>> colors;
+		bool colored = false;
+
+		// held particles follow a point on a body, or a fixed point when there is no body
+		std::vector<int> holds;
+		std::vector<RigidBody*> holders;
+		std::vector<Vector> holdOffsets;
+		std::vector<Vector> holdStarts, holdTargets;
+
+		std::vector<RigidBody*> nearby;
+
+		// greedily, like the resolver: each link takes the first color neither of its particles has yet,
+		// and the last batch holds the links that ran out of colors and is projected serially
+		void color() {
+			colors.assign(MAX_COLORS + 1, { });
+			std::vector<uint64_t> used (positions.size());
+			for (int i = 0; i < linkA.size(); i++) {
+				uint64_t taken = used[linkA[i]] | used[linkB[i]];
+				int index = taken == ~0ull ? MAX_COLORS : std::countr_one(taken);
+				colors[index].push_back(i);
+
+				if (index < MAX_COLORS) {
+					used[linkA[i]] |= 1ull << index;
+					used[linkB[i]] |= 1ull << index;
+				}
+			}
+			colored = true;
+		}
+
+		double getWeight(int index) const {
+			return held[index] ? 0.0 : invMasses[index];
+		}
+
+		void project(int link, double alpha) {
+			int a = linkA[link];
+			int b = linkB[link];
+			double wA = getWeight(a);
+			double wB = getWeight(b);
+			double weight = wA + wB + alpha;
+			if (weight == 0.0) return;
+
+			Vector delta = positions[b] - positions[a];
+			double distance = delta.mag();
+			if (distance == 0.0) return;
+
+			double change = (distance - lengths[link]) / (weight * distance);
+			positions[a] += delta * (change * wA);
+			positions[b] -= delta * (change * wB);
+		}
+
+		// the way out of the shape for a particle at the point and how far, if it is inside.
+		// polytopes take the face the particle is least far behind as their surface, which pushes out
+		// a little early around edges but is much cheaper than finding the closest point
+		bool touch(const Shape& shape, const Vector& point, Vector& normal, double& depth) const {
+			if (shape.type != Shape::POLYTOPE) {
+				std::optional<Collision> collision = Detector::collide(Ball(point, radius), shape);
+				if (!collision) return false;
+				normal = -collision->normal;
+				depth = collision->penetration;
+				return true;
+			}
+
+			const Plane* surface = nullptr;
+			double height = -INFINITY;
+			// face normals point inwards
+			for (const Plane& plane : ((const Polytope&)shape).planes) {
+				double distance = plane.distance - dot(plane.normal, point);
+				if (distance >= radius) return false;
+				if (distance > height) {
+					height = distance;
+					surface = &plane;
+				}
+			}
+
+			if (!surface) return false;
+			normal = -surface->normal;
+			depth = radius - height;
+			return true;
+		}
+
+		// pushes the particle out of whatever it ended up inside, then takes away its sliding
+		// relative to the surface, by no more than friction allows for how far it was pushed
+		void collide(int index, double dt) {
+			AABB bounds = AABB(radius) + positions[index];
+			for (RigidBody* body : nearby) {
+				if (!body->bounds.intersects(bounds)) continue;
+
+				for (const RigidBody::Collider& collider : body->colliders) {
+					if (!collider.bounds.intersects(bounds)) continue;
+
+					Vector normal;
+					double depth;
+					if (!touch(collider.cache(), positions[index], normal, depth)) continue;
+					positions[index] += normal * depth;
+
+					Vector surface = body->getPointVelocity(positions[index] - body->position.linear);
+					Vector slide = (positions[index] - lastPositions[index] - surface * dt).without(normal);
+					double slideDistance = slide.mag();
+					double limit = friction * body->friction * depth;
+					if (slideDistance > 0.0)
+						positions[index] -= slide * std::min(limit / slideDistance, 1.0);
+
+					bounds = AABB(radius) + positions[index];
+				}
+			}
+		}
+
+	public:
+		// each step is split into this many substeps of its own, which are cheap enough that the
+		// engine's iterations are usually too few to keep long ropes from stretching
+		API int substeps = 40;
+		API double compliance = 0.0;
+		API double radius = 0.1;
+		API double friction = 0.5;
+		API bool gravity = true;
+		API bool drag = true;
+		API bool canCollide = true;
+
+		// links are given as pairs of indices into the points, and keep the distance they start out at
+		API ParticleMesh(const std::vector<Vector>& points, const std::vector<int>& links) {
+			positions = points;
+			lastPositions = points;
+			velocities.assign(points.size(), Vector(0.0));
+			invMasses.assign(points.size(), 1.0);
+			held.assign(points.size(), false);
+
+			for (int i = 0; i + 1 < links.size(); i += 2)
+				addLink(links[i], links[i + 1]);
+		}
+
+		API static ParticleMesh* rope(const Vector& start, const Vector& end, int segments) {
+			std::vector<Vector> points;
+			std::vector<int> links;
+			for (int i = 0; i <= segments; i++) {
+				points.push_back(start + (end - start) * ((double)i / segments));
+				if (i) links.insert(links.end(), { i - 1, i });
+			}
+
+			return new ParticleMesh(points, links);
+		}
+
+		// a grid of particles across and down from the corner, linked to their neighbors along both
+		// directions and across both diagonals, which keeps it from shearing
+		API static ParticleMesh* cloth(const Vector& corner, const Vector& across, const Vector& down, int columns, int rows) {
+			std::vector<Vector> points;
+			std::vector<int> links;
+			auto at = [&](int column, int row) { return row * (columns + 1) + column; };
+			for (int row = 0; row <= rows; row++) {
+				for (int column = 0; column <= columns; column++) {
+					points.push_back(corner + across * ((double)column / columns) + down * ((double)row / rows));
+					if (column) links.insert(links.end(), { at(column - 1, row), at(column, row) });
+					if (row) links.insert(links.end(), { at(column, row - 1), at(column, row) });
+					if (column && row) {
+						links.insert(links.end(), { at(column - 1, row - 1), at(column, row) });
+						links.insert(links.end(), { at(column, row - 1), at(column - 1, row) });
+					}
+				}
+			}
+
+			return new ParticleMesh(points, links);
+		}
+
+		API void addLink(int a, int b) {
+			linkA.push_back(a);
+			linkB.push_back(b);
+			lengths.push_back((positions[b] - positions[a]).mag());
+			colored = false;
+		}
+
+		API int getCount() const {
+			return positions.size();
+		}
+
+		API int getLinkCount() const {
+			return linkA.size();
+		}
+
+		// pairs of particle indices, in the order the links were added
+		API std::vector<int> getLinks() const {
+			std::vector<int> result;
+			for (int i = 0; i < linkA.size(); i++)
+				result.insert(result.end(), { linkA[i], linkB[i] });
+			return result;
+		}
+
+		API Vector getPosition(int index) const {
+			return positions[index];
+		}
+
+		API void setPosition(int index, const Vector& position) {
+			positions[index] = position;
+			lastPositions[index] = position;
+		}
+
+		API std::vector<Vector> getPositions() const {
+			return positions;
+		}
+
+		API Vector getVelocity(int index) const {
+			return velocities[index];
+		}
+
+		API void setVelocity(int index, const Vector& velocity) {
+			velocities[index] = velocity;
+		}
+
+		API double getMass(int index) const {
+			return 1.0 / invMasses[index];
+		}
+
+		API void setMass(int index, double mass) {
+			invMasses[index] = 1.0 / mass;
+		}
+
+		// keeps the particle at a fixed point
+		API void hold(int index, const Vector& point) {
+			attach(index, nullptr, point);
+		}
+
+		// keeps the particle at an offset in the body's local space, dragged along wherever the body goes
+		// without pulling on it in return
+		API void attach(int index, RigidBody* body, const Vector& offset) {
+			release(index);
+			held[index] = true;
+			holds.push_back(index);
+			holders.push_back(body);
+			holdOffsets.push_back(offset);
+		}
+
+		API void release(int index) {
+			if (!held[index]) return;
+			held[index] = false;
+			for (int i = 0; i < holds.size(); i++) {
+				if (holds[i] != index) continue;
+				holds.erase(holds.begin() + i);
+				holders.erase(holders.begin() + i);
+				holdOffsets.erase(holdOffsets.begin() + i);
+				return;
+			}
+		}
+
+		API bool getHeld(int index) const {
+			return held[index];
+		}
+
+		// lets go of everything attached to the body, for when it is removed
+		void releaseBody(const RigidBody* body) {
+			for (int i = holds.size() - 1; i >= 0; i--)
+				if (holders[i] == body) release(holds[i]);
+		}
+
+		// everything the particles could reach during a step, for the broadphase
+		AABB getSweptBounds(const Vector& acceleration, double dt) const {
+			AABB bounds;
+			for (int i = 0; i < positions.size(); i++) {
+				bounds.add(positions[i]);
+				bounds.add(positions[i] + (velocities[i] + acceleration * dt) * dt);
+			}
+			for (int i = 0; i < holds.size(); i++)
+				bounds.add(holders[i] ? holders[i]->position * holdOffsets[i] : holdOffsets[i]);
+
+			return AABB(bounds.min - Vector(radius), bounds.max + Vector(radius));
+		}
+
+		// held particles are eased towards where their holders ended up over the substeps, while the rest fall
+		// and are projected much like the engine's small steps. the bodies given have their colliders cached already
+		void simulate(const std::vector<RigidBody*>& bodies, const Vector& acceleration, double damping, double deltaTime, bool parallel) {
+			if (positions.empty()) return;
+			if (!colored) color();
+
+			nearby.clear();
+			if (canCollide)
+				for (RigidBody* body : bodies)
+					if (!body->isTrigger) nearby.push_back(body);
+
+			holdStarts.clear();
+			holdTargets.clear();
+			for (int i = 0; i < holds.size(); i++) {
+				holdStarts.push_back(positions[holds[i]]);
+				holdTargets.push_back(holders[i] ? holders[i]->position * holdOffsets[i] : holdOffsets[i]);
+			}
+
+			auto forEach = [&](int count, const auto& body) {
+				if (parallel) threadPool.forEach(count, body, BATCH_GRAIN);
+				else for (int i = 0; i < count; i++) body(i);
+			};
+
+			double dt = deltaTime / substeps;
+			double alpha = compliance / (dt * dt);
+			double dragFactor = std::pow(1.0 - damping, dt);
+			Vector scaledGravity = acceleration * dt;
+
+			for (int step = 1; step <= substeps; step++) {
+				forEach(positions.size(), [&](int i) {
+					lastPositions[i] = positions[i];
+					if (held[i]) return;
+					if (gravity) velocities[i] += scaledGravity;
+					if (drag) velocities[i] *= dragFactor;
+					positions[i] += velocities[i] * dt;
+				});
+
+				double progress = (double)step / substeps;
+				for (int i = 0; i < holds.size(); i++)
+					positions[holds[i]] = holdStarts[i] + (holdTargets[i] - holdStarts[i]) * progress;
+
+				for (int c = 0; c < MAX_COLORS; c++) {
+					const std::vector<int>& batch = colors[c];
+					if (batch.empty()) break;
+					forEach(batch.size(), [&](int i) { project(batch[i], alpha); });
+				}
+				for (int link : colors[MAX_COLORS])
+					project(link, alpha);
+
+				if (!nearby.empty())
+					forEach(positions.size(), [&](int i) { if (!held[i]) collide(i, dt); });
+
+				forEach(positions.size(), [&](int i) {
+					velocities[i] = (positions[i] - lastPositions[i]) * (1.0 / dt);
+				});
+			}
+		}
+};
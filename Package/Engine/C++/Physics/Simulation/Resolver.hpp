@@ -2,9 +2,12 @@
 
 #include <vector>
 #include <concepts>
+#include <bit>
 
 #include "../../Global.hpp"
+#include "../../Util/ThreadPool.hpp"
 #include "../Math/Random.hpp"
+#include "SolverBodies.hpp"
 #include "Constraint/Constraint.hpp"
 
 template <std::derived_from<Constraint> T>
@@ -12,17 +15,84 @@ class Resolver {
 	private:
 		using Solve = void (T::*)(double);
 
-		std::vector<std::unique_ptr<T>> staticConstraints, dynamicConstraints;
+		static constexpr int MAX_COLORS = 64;
+		static constexpr int BATCH_GRAIN = 32;
 
-		std::vector<std::unique_ptr<T>>& getConstraintList(T* con) {
+		// constraints are owned by their descriptors or pools, and only referenced here
+		std::vector<T*> staticConstraints, dynamicConstraints;
+		std::vector<std::vector<T*>> colors;
+		SolverBodies solverBodies;
+
+		// static bodies are shared between islands, so only dynamic bodies are ever tagged
+		void gather() {
+			solverBodies.clear();
+
+			for (auto* list : { &dynamicConstraints, &staticConstraints })
+				for (T* con : *list) {
+					con->bodyA.solverIndex = SolverBodies::NONE;
+					if (con->dynamic) con->bodyB.solverIndex = SolverBodies::NONE;
+				}
+
+			for (auto* list : { &dynamicConstraints, &staticConstraints })
+				for (T* con : *list) {
+					con->solver = &solverBodies;
+					con->indexA = solverBodies.add(con->bodyA);
+					if (con->dynamic) con->indexB = solverBodies.add(con->bodyB);
+				}
+		}
+
+		std::vector<T*>& getConstraintList(T* con) {
 			return con->dynamic ? dynamicConstraints : staticConstraints;
 		}
 
+		// greedily assigns each constraint the first color that none of its movable bodies have,
+		// in list order so that the batches are the same on every run.
+		// the last batch holds the constraints that ran out of colors and is solved serially
+		void color(const std::vector<T*>& constraints) {
+			for (auto& batch : colors)
+				batch.clear();
+			colors.resize(MAX_COLORS + 1);
+
+			// static bodies may be shared with other islands, so only dynamic ones are marked
+			for (T* con : constraints)
+				for (RigidBody* body : { &con->bodyA, &con->bodyB })
+					if (body->getDynamic()) body->colors = 0;
+
+			for (T* con : constraints) {
+				uint64_t used = 0;
+				for (RigidBody* body : { &con->bodyA, &con->bodyB })
+					if (body->getDynamic()) used |= body->colors;
+
+				int index = used == ~0ull ? MAX_COLORS : std::countr_one(used);
+				colors[index].push_back(con);
+
+				if (index < MAX_COLORS)
+					for (RigidBody* body : { &con->bodyA, &con->bodyB })
+						if (body->getDynamic()) body->colors |= 1ull << index;
+			}
+		}
+
 		template <Solve S>
-		void solveConstraints(std::vector<std::unique_ptr<T>>& constraints, double dt) {
-			rng.shuffle(constraints);
-			for (const auto& con : constraints)
-				(con.get()->*S)(dt);
+		void solveConstraints(std::vector<T*>& constraints, double dt) {
+			random->shuffle(constraints);
+
+			if (!parallel) {
+				for (T* con : constraints)
+					(con->*S)(dt);
+				return;
+			}
+
+			color(constraints);
+			for (int i = 0; i < MAX_COLORS; i++) {
+				const std::vector<T*>& batch = colors[i];
+				if (batch.empty()) continue;
+				threadPool.forEach(batch.size(), [&](int j) {
+					(batch[j]->*S)(dt);
+				}, BATCH_GRAIN);
+			}
+
+			for (T* con : colors[MAX_COLORS])
+				(con->*S)(dt);
 		}
 		
 		template <typename U, void (U::* S)(double)>
@@ -33,7 +103,94 @@ class Resolver {
 			}
 		}
 
+		// the solver index of a constraint's other body, if it moves at all this step.
+		// bodies held still by prohibited directions are only found if some other constraint gathered them
+		uint32_t getGatheredB(T* con) const {
+			if (con->dynamic) return con->indexB;
+			if (!con->bodyB.getDynamic()) return SolverBodies::NONE;
+
+			uint32_t index = con->bodyB.solverIndex;
+			bool gathered = index < solverBodies.bodies.size() && solverBodies.bodies[index] == &con->bodyB;
+			return gathered ? index : SolverBodies::NONE;
+		}
+
+		// shock propagation: a last pass from the bottom of every stack up, holding everything underneath still.
+		// a body's layer is how many contacts away it is from a body that never moves, and each constraint is solved
+		// with the layer of its higher body, after the layers below that have been frozen in the solver
+		void propagateShock() {
+			uint32_t bodyCount = solverBodies.bodies.size();
+			std::vector<uint32_t> offsets (bodyCount + 1);
+			std::vector<std::pair<uint32_t, uint32_t>> links;
+			std::vector<int> layers (bodyCount, -1);
+			std::vector<uint32_t> order;
+
+			for (auto* list : { &dynamicConstraints, &staticConstraints })
+				for (T* con : *list) {
+					uint32_t indexB = getGatheredB(con);
+					if (indexB != SolverBodies::NONE) {
+						links.push_back({ con->indexA, indexB });
+						offsets[con->indexA + 1]++;
+						offsets[indexB + 1]++;
+					} else if (!con->dynamic && !con->bodyB.getDynamic() && layers[con->indexA] < 0) {
+						layers[con->indexA] = 0;
+						order.push_back(con->indexA);
+					}
+				}
+
+			for (uint32_t i = 0; i < bodyCount; i++)
+				offsets[i + 1] += offsets[i];
+
+			std::vector<uint32_t> neighbors (links.size() * 2);
+			std::vector<uint32_t> fill (offsets.begin(), offsets.end() - 1);
+			for (auto [a, b] : links) {
+				neighbors[fill[a]++] = b;
+				neighbors[fill[b]++] = a;
+			}
+
+			// breadth first, so the order bodies are reached in is also their order by layer
+			for (int i = 0; i < order.size(); i++)
+				for (uint32_t j = offsets[order[i]]; j < offsets[order[i] + 1]; j++)
+					if (layers[neighbors[j]] < 0) {
+						layers[neighbors[j]] = layers[order[i]] + 1;
+						order.push_back(neighbors[j]);
+					}
+
+			// bodies that rest on nothing have no bottom to start from, and are left to the iterations
+			auto getLayer = [&](T* con) {
+				int layerA = layers[con->indexA];
+				uint32_t indexB = getGatheredB(con);
+				if (indexB == SolverBodies::NONE) return layerA;
+				int layerB = layers[indexB];
+				return layerA < 0 || layerB < 0 ? -1 : std::max(layerA, layerB);
+			};
+
+			int layerCount = order.empty() ? 0 : layers[order.back()] + 1;
+			std::vector<std::vector<T*>> byLayer (layerCount);
+			for (auto* list : { &staticConstraints, &dynamicConstraints })
+				for (T* con : *list) {
+					int layer = getLayer(con);
+					if (layer >= 0) byLayer[layer].push_back(con);
+				}
+
+			int frozen = 0;
+			for (int layer = 0; layer < layerCount; layer++) {
+				for (; frozen < order.size() && layers[order[frozen]] < layer; frozen++) {
+					solverBodies.invMass[order[frozen]] = 0.0;
+					solverBodies.invInertia[order[frozen]] *= 0.0;
+				}
+
+				for (T* con : byLayer[layer])
+					con->solveShock();
+			}
+		}
+
 	public:
+		// solves constraints color by color on the thread pool instead of one by one
+		bool parallel = false;
+		// ends velocity iterations with a pass of shock propagation, for constraints that support it
+		bool shockPropagation = false;
+		Random* random = &rng;
+
 		Resolver() {
 
 		}
@@ -45,22 +202,73 @@ class Resolver {
 
 		void addConstraint(T* con) {
 			if (con == nullptr) return;
-			getConstraintList(con).emplace_back(con);
+			getConstraintList(con).push_back(con);
+		}
+
+		// hands every constraint over in order, leaving none
+		std::vector<T*> take() {
+			std::vector<T*> result = dynamicConstraints;
+			result.insert(result.end(), staticConstraints.begin(), staticConstraints.end());
+			clear();
+			return result;
+		}
+
+		// hands every constraint over to the resolver picked for it, keeping their order
+		template <typename F>
+		void distribute(F target) {
+			for (auto* list : { &dynamicConstraints, &staticConstraints })
+				for (T* con : *list)
+					target(*con).addConstraint(con);
+			clear();
 		}
 		
 		double getError() const {
 			double result = 0;
-			for (const auto& con : staticConstraints)
+			for (T* con : staticConstraints)
 				result += con->getError();
-			for (const auto& con : dynamicConstraints)
+			for (T* con : dynamicConstraints)
 				result += con->getError();
 			return result;	
 		}
 
+		// lets every constraint cache what the iterations need. each only writes to itself, so order doesn't matter
+		void prestep(double dt) {
+			for (auto* list : { &dynamicConstraints, &staticConstraints }) {
+				if (parallel) {
+					threadPool.forEach(list->size(), [&](int i) {
+						(*list)[i]->prestep(dt);
+					}, BATCH_GRAIN);
+				} else {
+					for (T* con : *list)
+						con->prestep(dt);
+				}
+			}
+		}
+
 		template <void (Constraint::* S)(double)>
 		void solve(double dt, int count = 1) {
 			solve<Constraint, S>(dt, count);
 		}
+
+		// velocity iterations, run on packed copies of the bodies' velocities
+		template <typename U, void (U::* S)(double)>
+		void solveVelocities(double dt, int count) {
+			gather();
+			solve<U, S>(dt, count);
+			if constexpr (requires (T con) { con.solveShock(); })
+				if (shockPropagation) propagateShock();
+			solverBodies.scatter();
+		}
+
+		template <void (Constraint::* S)(double)>
+		void solveVelocities(double dt, int count = 1) {
+			solveVelocities<Constraint, S>(dt, count);
+		}
+
+		template <void (T::* S)(double)>
+		void solveVelocities(double dt, int count = 1) {
+			solveVelocities<T, S>(dt, count);
+		}
 		
 		template <void (T::* S)(double)>
 		void solve(double dt, int count = 1) {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <unordered_set>
+#include <algorithm>
 
 #include "../Math/Transform.hpp"
 #include "Shape.hpp"
@@ -58,6 +59,7 @@ class RayHit {
 using Derivative = Transform RigidBody::*;
 
 class ConstraintDescriptor;
+class Articulation;
 
 API class RigidBody {
 	private:
@@ -87,37 +89,147 @@ API class RigidBody {
 				}
 		};
 	
+		// bounding volume hierarchy over the colliders in the body's model space,
+		// used to find the collider pairs worth testing between two compound bodies
+		class ColliderTree {
+			private:
+				class Node {
+					public:
+						AABB bounds;
+						int children[2] { -1, -1 };
+						int collider = -1;
+				};
+
+				std::vector<Node> nodes;
+
+				static AABB transformBounds(const AABB& box, const Transform& transf) {
+					AABB result;
+					for (int i = 0; i < (1 << DIM); i++) {
+						Vector corner;
+						for (int j = 0; j < DIM; j++)
+							corner[j] = (i >> j & 1 ? box.max : box.min)[j];
+						result.add(transf * corner);
+					}
+					return result;
+				}
+
+				int build(std::vector<std::pair<AABB, int>>& items, int begin, int end) {
+					int index = nodes.size();
+					nodes.emplace_back();
+					for (int i = begin; i < end; i++)
+						nodes[index].bounds.add(items[i].first);
+
+					if (end - begin == 1) {
+						nodes[index].collider = items[begin].second;
+						return index;
+					}
+
+					// median split along the longest axis
+					Vector size = nodes[index].bounds.max - nodes[index].bounds.min;
+					int axis = 0;
+					for (int i = 1; i < DIM; i++)
+						if (size[i] > size[axis]) axis = i;
+
+					int middle = (begin + end) / 2;
+					std::nth_element(
+						items.begin() + begin, items.begin() + middle, items.begin() + end,
+						[=](const auto& a, const auto& b) {
+							return a.first.min[axis] + a.first.max[axis] < b.first.min[axis] + b.first.max[axis];
+						}
+					);
+
+					int left = build(items, begin, middle);
+					int right = build(items, middle, end);
+					nodes[index].children[0] = left;
+					nodes[index].children[1] = right;
+					return index;
+				}
+
+				template <typename F>
+				void query(int node, const ColliderTree& other, int otherNode, const Transform& toThis, F& callback) const {
+					const Node& a = nodes[node];
+					const Node& b = other.nodes[otherNode];
+					if (!a.bounds.intersects(transformBounds(b.bounds, toThis))) return;
+
+					bool leafA = a.collider >= 0;
+					bool leafB = b.collider >= 0;
+					if (leafA && leafB) {
+						callback(a.collider, b.collider);
+						return;
+					}
+
+					if (leafB || (!leafA && a.bounds.volume() > b.bounds.volume())) {
+						for (int child : a.children)
+							query(child, other, otherNode, toThis, callback);
+					} else {
+						for (int child : b.children)
+							query(node, other, child, toThis, callback);
+					}
+				}
+
+			public:
+				void build(const std::vector<AABB>& bounds) {
+					nodes.clear();
+					if (bounds.empty()) return;
+
+					std::vector<std::pair<AABB, int>> items;
+					for (int i = 0; i < bounds.size(); i++)
+						items.emplace_back(bounds[i], i);
+					build(items, 0, items.size());
+				}
+
+				// toThis maps the other tree's space into this one
+				template <typename F>
+				void query(const ColliderTree& other, const Transform& toThis, F callback) const {
+					if (nodes.empty() || other.nodes.empty()) return;
+					query(0, other, 0, toThis, callback);
+				}
+		};
+	
 		bool dynamic;
+		bool kinematic = false;
 		double density = 1;
 		Transform lastPosition = Transform::DIFFERENT;
 		Orientation lastBoundedOrientation;
 		bool shapesModified = false;
-
-		void syncMatter() {
-			if (dynamic && canRotate) {
-				matter = localMatter.rotate(position.orientation);
-			} else {
-				matter.mass = dynamic ? localMatter.mass : INFINITY;
-				matter.inertia = INFINITY;
-				matter.computeInverses();
-			}
-		}
+		ColliderTree colliderTree;
+		// the orientation matter was last rotated to, unless something has put its own matter in place since
+		Orientation matterOrientation;
+		bool matterStale = true;
 
 		void updateLocalBounds() {
 			lastBoundedOrientation = position.orientation;
-			for (Collider& collider : colliders)
+			localBounds = { };
+			for (Collider& collider : colliders) {
 				collider.updateLocalBounds();
+				localBounds.add(collider.localBounds);
+			}
+		}
+
+		void buildColliderTree() {
+			std::vector<AABB> bounds;
+			for (const Collider& collider : colliders)
+				bounds.push_back(collider.getModelBounds());
+			colliderTree.build(bounds);
+		}
+
+		void updatePrincipalMatter() {
+			principalMatter = localMatter;
+			matterStale = true;
+			syncMatter();
 		}
 
 		void modifyShapes() {
 			shapesModified = true;
+			wake();
 		}
 
-		void ensureShapes() { // lastBoundedOrientation, collider bounds, matter
+		void ensureShapes() { // lastBoundedOrientation, collider bounds, collider tree, matter
 			if (shapesModified) {
 				shapesModified = false;
 				updateLocalBounds();
-				syncMatter();
+				buildColliderTree();
+				updatePrincipalMatter();
 			}
 		}
 
@@ -131,7 +243,6 @@ API class RigidBody {
 			public:
 				RigidBody* body;
 				AABB localBounds, bounds;
-				size_t wave;
 				
 				Collider(RigidBody* _body, Shape* _local) {
 					body = _body;
@@ -151,10 +262,22 @@ API class RigidBody {
 				void beforeSimulation() {
 					global->clearCache();
 				}
+
+				AABB getModelBounds() const {
+					return local->getBounds();
+				}
+
+				std::optional<AABB> takeEdits() {
+					return local->takeEdits(body->position);
+				}
+
+				bool hasMatter() const {
+					return local->hasMatter();
+				}
 		
 				void updateLocalBounds() {
 					global->sync(*local, { { }, body->position.orientation });
-					localBounds = body->dynamic ? global->getBallBounds() : global->getBounds();
+					localBounds = body->dynamic || body->kinematic ? global->getBallBounds() : global->getBounds();
 					valid = false;
 				}
 		
@@ -173,6 +296,10 @@ API class RigidBody {
 		};
 
 		std::vector<Collider> colliders;
+		AABB localBounds, bounds;
+		size_t wave;
+		uint64_t colors;
+		uint32_t solverIndex;
 
 		API_CONST Transform position;
 		API_CONST Transform velocity;
@@ -180,9 +307,14 @@ API class RigidBody {
 		API int name;
 		
 		Matter localMatter, matter;
+		PrincipalMatter principalMatter;
 		
 		Prohibited prohibited;
+		// where the body began the step, which small steps measure static friction from
+		Transform stepStart;
 		API_CONST std::vector<ConstraintDescriptor*> constraintDescriptors;
+		// set while the body is a moving link of an articulation, which places it instead of the engine
+		Articulation* articulation = nullptr;
 		
 		bool finalized = false;
 		bool checkChanges = true;
@@ -202,6 +334,23 @@ API class RigidBody {
 		API bool canCollide = true;
 		API bool trivialCollisionRule = true;
 
+		// islands
+		int index = -1;
+		bool linkedDynamic = false;
+		std::vector<RigidBody*> touching;
+
+		// kinematic
+		Transform target;
+		bool targeted = false;
+		bool hashedKinematic = false;
+
+		// sleep
+		API bool canSleep = true;
+		std::shared_ptr<std::vector<RigidBody*>> sleepGroup;
+		Transform sleepPosition;
+		double sleepTime = 0;
+		bool wakeRequested = false;
+
 		RigidBody(const Transform& _position, bool _dynamic)
 		: RigidBody(_dynamic) {
 			position = _position;
@@ -211,12 +360,48 @@ API class RigidBody {
 			dynamic = _dynamic;
 		}
 
+		API bool getSleeping() const {
+			return (bool)sleepGroup;
+		}
+
+		// wakes the body (and everything it rests with) at the start of the next step
+		API void wake() {
+			wakeRequested = true;
+		}
+
+		// positions round-trip through the caller every step, so only a real change counts as a disturbance
+		bool hasMovedFrom(const Transform& other) const {
+			if ((position.linear - other.linear).sqrMag() > EPSILON * EPSILON) return true;
+			auto turn = (position.orientation + -other.orientation).getRotation();
+			return IF_3D(turn.mag(), std::abs(turn)) > EPSILON;
+		}
+
+		bool shouldWake() const {
+			return wakeRequested || !(velocity == Transform()) || hasMovedFrom(sleepPosition);
+		}
+
+		// whether a static body was moved or changed since this was last called
+		bool takeDisturbance() {
+			bool disturbed = wakeRequested || hasMovedFrom(lastPosition);
+			wakeRequested = false;
+			lastPosition = position;
+			return disturbed;
+		}
+
 		API std::vector<Vector> getProhibitedDirections() const {
 			return prohibited.prohibited;
 		}
 
+		bool canBeDynamic() const {
+			for (const Collider& collider : colliders)
+				if (!collider.hasMatter()) return false;
+			return true;
+		}
+
 		API void setDynamic(bool _dynamic) {
-			dynamic = _dynamic;
+			wake();
+			dynamic = _dynamic && canBeDynamic();
+			if (dynamic) kinematic = false;
 			updateLocalBounds();
 			syncMatter();
 		}
@@ -225,9 +410,32 @@ API class RigidBody {
 			return dynamic;
 		}
 
+		// kinematic bodies aren't dynamic, but are moved to a target each step rather than being held in place.
+		// nothing pushes them, while they push everything and carry along whatever rests on them
+		API void setKinematic(bool _kinematic) {
+			wake();
+			kinematic = _kinematic;
+			if (kinematic) dynamic = false;
+			velocity = { };
+			targeted = false;
+			updateLocalBounds();
+			syncMatter();
+		}
+
+		API bool getKinematic() const {
+			return kinematic;
+		}
+
+		// where a kinematic body should be by the end of the next step
+		API void setTarget(const Transform& _target) {
+			target = _target;
+			targeted = true;
+		}
+
 		API void setDensity(double _density) {
+			wake();
 			localMatter *= _density / density;
-			syncMatter();
+			updatePrincipalMatter();
 			density = _density;
 		}
 
@@ -243,9 +451,11 @@ API class RigidBody {
 			return localMatter.rotate(position.orientation).inertia;
 		}
 
+		// a shape without matter would leave a dynamic body massless, so it makes the body static instead
 		API void addShape(Shape* shape) {
 			localMatter += shape->getMatter() * density;
 			colliders.emplace_back(this, shape);
+			if (!shape->hasMatter()) dynamic = false;
 			modifyShapes();
 		}
 		
@@ -274,7 +484,10 @@ API class RigidBody {
 			return !trivialTriggerRule && triggerRule(*this, other);
 		}
 
+		bool isArticulatedWith(const RigidBody& other) const;
+
 		bool canCollideWith(const RigidBody& other) const {
+			if (isArticulatedWith(other)) return false;
 			return trivialCollisionRule || collisionRule(*this, other);
 		}
 
@@ -286,23 +499,29 @@ API class RigidBody {
 		}
 
 		void recomputeVelocity(double dt) {
-			velocity = (position - lastPosition) * (1.0 / dt);
+			// the turn taken since, in world space like the velocity it is integrated from
+			Orientation turn = position.orientation * -lastPosition.orientation;
+			velocity = Transform(position.linear - lastPosition.linear, turn) * (1.0 / dt);
 		}
 
 		template <Derivative D>
 		void applyRelativeImpulse(const Vector& offset, const Vector& imp) {
+			applyImpulseAndTorque<D>(imp, cross(offset, imp));
+		}
+
+		template <Derivative D>
+		void applyImpulseAndTorque(const Vector& imp, const Cross& torque) {
 			Vector linearDelta = matter.invMass * imp;
 			
 			(this->*D).linear += linearDelta;
 
-			if (canRotate) {
-				Cross torque = cross(offset, imp);
+			if (canRotate)
 				ONLY_2D(if (torque)) (this->*D).orientation += Orientation(matter.invInertia * torque);
-			}
 		}
 
 		API void applyImpulse(const Vector& pos, const Vector& imp) {
 			if (!dynamic) return;
+			wake();
 			ensureShapes();
 			applyRelativeImpulse<&RigidBody::velocity>(pos - position.linear, imp);
 		}
@@ -311,6 +530,7 @@ API class RigidBody {
 			if (!checkChanges) return;
 
 			ensureShapes();
+			if (kinematic) return;
 			if (!dynamic && lastBoundedOrientation != position.orientation)
 				updateLocalBounds();
 	
@@ -326,11 +546,63 @@ API class RigidBody {
 				checkChanges = false;
 		}
 
+		// world matter only changes with orientation, so it is left alone until the body turns
+		void syncMatter() {
+			if (dynamic && canRotate) {
+				if (matterStale || !(matterOrientation == position.orientation)) {
+					matterStale = false;
+					matterOrientation = position.orientation;
+					matter = principalMatter.rotate(position.orientation);
+				}
+			} else {
+				matterStale = true;
+				matter.mass = dynamic ? localMatter.mass : INFINITY;
+				matter.inertia = INFINITY;
+				matter.computeInverses();
+			}
+		}
+
 		void syncWithPosition() {
 			syncMatter();
 
+			bounds = localBounds + position.linear;
+
+			for (Collider& collider : colliders)
+				collider.syncWithPosition();
+		}
+
+		// takes a kinematic body to its target, with the velocity that gets it there over the step.
+		// its bounds don't depend on its orientation and its matter never changes, so only the colliders follow it.
+		// returns whether it moved, since one left where it is costs nothing
+		bool advance(double dt) {
+			bool moved = targeted && !(target == position);
+			targeted = false;
+			if (!moved) {
+				velocity = { };
+				return false;
+			}
+
+			lastPosition = position;
+			position = target;
+			recomputeVelocity(dt);
+
+			bounds = localBounds + position.linear;
 			for (Collider& collider : colliders)
 				collider.syncWithPosition();
+			return true;
+		}
+
+		// for whatever stands in for the body's own matter until the next syncMatter after it is returned
+		void lendMatter(const Matter& lent) {
+			matter = lent;
+			matterStale = true;
+		}
+
+		// for whatever places the body in the engine's stead
+		void moveTo(const Transform& next) {
+			lastPosition = position;
+			position = next;
+			syncWithPosition();
 		}
 
 		void integrate(double dt) {
@@ -341,9 +613,8 @@ API class RigidBody {
 #if IS_3D
 				// precession
 				Orientation next = position.orientation + velocity.orientation * dt;
-				Inertia invInertia = localMatter.rotate(next).invInertia;
 				velocity.orientation = Orientation(
-					invInertia * matter.inertia * velocity.orientation.getRotation()
+					principalMatter.getTurning(next, matter.inertia * velocity.orientation.getRotation())
 				);
 #endif
 			} else {
@@ -354,6 +625,18 @@ API class RigidBody {
 			syncWithPosition();
 		}
 
+		template <typename F>
+		void queryColliders(const RigidBody& other, F callback) const {
+			if (colliders.size() == 1 && other.colliders.size() == 1) {
+				callback(colliders[0], other.colliders[0]);
+				return;
+			}
+
+			colliderTree.query(other.colliderTree, position.inverse() * other.position, [&](int a, int b) {
+				callback(colliders[a], other.colliders[b]);
+			});
+		}
+
 		RayHit raycast(const Ray& ray) const {
 			RayHit best;
 
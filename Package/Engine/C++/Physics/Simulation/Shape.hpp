@@ -1,19 +1,43 @@
 #pragma once
 
 #include "../Math/Face.hpp"
+#include "../Math/Hull.hpp"
+#include "../Math/Decomposition.hpp"
 #include "../Math/Transform.hpp"
 #include "../../Math/AABB.hpp"
 #include "../../Math/Shadow.hpp"
 #include "Matter.hpp"
+#include "../../Util/ThreadPool.hpp"
 
 #include <unordered_map>
+#include <memory>
+#include <array>
+#if THREADS
+#include <mutex>
+#endif
 
 API class Shape {
 	protected:
 		virtual void output(std::ostream& out) const = 0;
+
+		// the radius about the origin that reaches every corner of the box
+		static double getCornerRadius(const AABB& box) {
+			Vector corner;
+			for (int i = 0; i < DIM; i++)
+				corner[i] = std::max(std::abs(box.min[i]), std::abs(box.max[i]));
+			return corner.mag();
+		}
 	
 	public:
-		enum Type { BALL, POLYTOPE, COUNT };
+		enum Type {
+			BALL, POLYTOPE,
+#if IS_3D
+			HEIGHTFIELD,
+#else
+			TILEMAP,
+#endif
+			COUNT
+		};
 		Type type;
 		Shape* model;
 
@@ -26,9 +50,13 @@ API class Shape {
 		virtual void clearCache() { }
 		virtual void sync(const Shape&, const Transform& transf) = 0;
 		virtual Matter getMatter() const = 0;
+		// shapes without matter of their own (terrain) can only be held by bodies that aren't pushed around
+		virtual bool hasMatter() const { return true; }
 		virtual AABB getBounds() const = 0;
 		virtual AABB getBallBounds() const = 0;
 		virtual double raycast(const Ray& ray) const = 0;
+		// where a shape edited in place has changed since this was last called, placed by transf
+		virtual std::optional<AABB> takeEdits(const Transform& transf) { return std::nullopt; }
 
 		friend std::ostream& operator <<(std::ostream& out, const Shape& shape) {
 			shape.output(out);
@@ -113,113 +141,195 @@ API class Polytope : public Shape {
 	private:
 		using IndexFace = std::array<int, DIM>;
 		using IndexEdge = std::array<int, 2>;
-		
-		std::vector<IndexFace> faces;
-		std::vector<IndexEdge> edges;
-
-		static Matter getComponentMatter(const Face& face) {
-			Matrix fromAligned = IF_3D(
-				Matrix(face.a, face.b, face.c),
-				Matrix(face.start, face.end)
-			);
 
-			double determinant = fromAligned.determinant();
-			double mass = determinant / factorial(DIM);
-			
-			auto product = [&](int xIndex, int yIndex) {
-				Vector x = fromAligned.row(xIndex);
-				Vector y = fromAligned.row(yIndex);
-				return x.sum() * y.sum() + x.sqrMag();
-			};
+		// immutable cooked data, shared between every instance of the same shape
+		class Geometry {
+			private:
+				Face getFace(int index) const {
+					std::array<Vector, DIM> points;
+					for (int i = 0; i < points.size(); i++)
+						points[i] = vertices[faces[index][i]];
+					return points;
+				}
+
+				static Matter getComponentMatter(const Face& face) {
+					Matrix fromAligned = IF_3D(
+						Matrix(face.a, face.b, face.c),
+						Matrix(face.start, face.end)
+					);
+
+					double determinant = fromAligned.determinant();
+					double mass = determinant / factorial(DIM);
+					
+					auto product = [&](int xIndex, int yIndex) {
+						Vector x = fromAligned.row(xIndex);
+						Vector y = fromAligned.row(yIndex);
+						return x.sum() * y.sum() + dot(x, y);
+					};
 
 #if IS_3D
-			Inertia rawInertia {
-				product(1, 1) + product(2, 2), -product(0, 1), -product(0, 2),
-				-product(0, 1), product(0, 0) + product(2, 2), -product(1, 2),
-				-product(0, 2), -product(1, 2), product(0, 0) + product(1, 1)
-			};
+					Inertia rawInertia {
+						product(1, 1) + product(2, 2), -product(0, 1), -product(0, 2),
+						-product(0, 1), product(0, 0) + product(2, 2), -product(1, 2),
+						-product(0, 2), -product(1, 2), product(0, 0) + product(1, 1)
+					};
 #else		
 
-			Inertia rawInertia = product(0, 0) + product(1, 1);
+					Inertia rawInertia = product(0, 0) + product(1, 1);
 #endif
-			
-			double coefficient = determinant / factorial(DIM + 2);
-			return { mass, rawInertia * coefficient, false };
-		}
+					
+					double coefficient = determinant / factorial(DIM + 2);
+					return { mass, rawInertia * coefficient, false };
+				}
 
-		void computeDependentData() {
+				void computeDependentData() {
 #if IS_3D
-			// de-duplicate
-			std::unordered_map<Vector, int> indexMapping;
-			std::vector<Vector> uniqueVertices;
-			for (const Vector& vertex : vertices) {
-				if (!indexMapping.count(vertex)) {
-					indexMapping.insert(std::make_pair(vertex, uniqueVertices.size()));
-					uniqueVertices.push_back(vertex);
-				}
-			}
+					// de-duplicate
+					std::unordered_map<Vector, int> indexMapping;
+					std::vector<Vector> uniqueVertices;
+					for (const Vector& vertex : vertices) {
+						if (!indexMapping.count(vertex)) {
+							indexMapping.insert(std::make_pair(vertex, uniqueVertices.size()));
+							uniqueVertices.push_back(vertex);
+						}
+					}
 
-			std::vector<IndexFace> uniqueFaces;
-			auto mapIndex = [&](int index) {
-				return indexMapping[vertices[index]];
-			};
+					std::vector<IndexFace> uniqueFaces;
+					auto mapIndex = [&](int index) {
+						return indexMapping[vertices[index]];
+					};
 
-			for (const IndexFace& face : faces)
-				uniqueFaces.push_back({
-					mapIndex(face[0]),
-					mapIndex(face[1]),
-					mapIndex(face[2])
-				});
+					for (const IndexFace& face : faces)
+						uniqueFaces.push_back({
+							mapIndex(face[0]),
+							mapIndex(face[1]),
+							mapIndex(face[2])
+						});
 
-			vertices = uniqueVertices;
-			faces = uniqueFaces;
+					vertices = uniqueVertices;
+					faces = uniqueFaces;
 #endif
 
-			position = average(vertices);
-			
-			std::unordered_set<Plane> discoveredPlanes;
-			for (int i = 0; i < faces.size(); i++) {
-				Vector normal = getFace(i).normal();
-				Plane plane { normal, dot(normal, vertices[faces[i][0]]) };
-				if (!discoveredPlanes.count(plane)) {
-					discoveredPlanes.insert(plane);
-					if (normal.unit()) planes.push_back(plane);
-				}
-			}
+					position = average(vertices);
+					
+					std::unordered_set<Plane> discoveredPlanes;
+					for (int i = 0; i < faces.size(); i++) {
+						Vector normal = getFace(i).normal();
+						Plane plane { normal, dot(normal, vertices[faces[i][0]]) };
+						if (!discoveredPlanes.count(plane)) {
+							discoveredPlanes.insert(plane);
+							if (normal.unit()) planes.push_back(plane);
+						}
+					}
 
 #if IS_3D
-			std::unordered_map<std::pair<int, int>, Vector> discoveredEdges;
-			auto addEdge = [&](int a, int b, const Vector& normal) {
-				std::pair<int, int> key = a < b ? std::make_pair(a, b) : std::make_pair(b, a);
-				if (!discoveredEdges.count(key)) {
-					discoveredEdges.insert_or_assign(key, normal);
-				} else if (discoveredEdges.at(key) == normal) {
-					discoveredEdges.erase(key);
+					std::unordered_map<std::pair<int, int>, Vector> discoveredEdges;
+					auto addEdge = [&](int a, int b, const Vector& normal) {
+						std::pair<int, int> key = a < b ? std::make_pair(a, b) : std::make_pair(b, a);
+						if (!discoveredEdges.count(key)) {
+							discoveredEdges.insert_or_assign(key, normal);
+						} else if (discoveredEdges.at(key) == normal) {
+							discoveredEdges.erase(key);
+						}
+					};
+
+					for (int i = 0; i < faces.size(); i++) {
+						Vector normal = getFace(i).normal();
+						auto [a, b, c] = faces[i];
+						addEdge(a, b, normal);
+						addEdge(b, c, normal);
+						addEdge(a, c, normal);
+					}
+
+					std::unordered_set<Vector> discoveredEdgeAxes;
+					for (const auto& [edge, normal] : discoveredEdges) {
+						Vector a = vertices[edge.first];
+						Vector b = vertices[edge.second];
+						Vector edgeAxis = (b - a).idemparallel();
+						if (!discoveredEdgeAxes.count(edgeAxis)) {
+							discoveredEdgeAxes.insert(edgeAxis);
+							if (edgeAxis.unit()) edgeAxes.push_back(edgeAxis);
+						}
+						edges.push_back({ edge.first, edge.second });
+					}
+#else
+					edges = faces;
+#endif
+
+					for (int i = 0; i < faces.size(); i++)
+						matter += getComponentMatter(getFace(i));
 				}
-			};
 
-			for (int i = 0; i < faces.size(); i++) {
-				Vector normal = getFace(i).normal();
-				auto [a, b, c] = faces[i];
-				addEdge(a, b, normal);
-				addEdge(b, c, normal);
-				addEdge(a, c, normal);
-			}
+			public:
+				std::vector<Vector> vertices;
+				std::vector<IndexFace> faces;
+				std::vector<IndexEdge> edges;
+				std::vector<Plane> planes;
+				std::vector<Vector> edgeAxes;
+				Vector position;
+				Matter matter { 0.0, 0.0, false };
 
-			std::unordered_set<Vector> discoveredEdgeAxes;
-			for (const auto& [edge, normal] : discoveredEdges) {
-				Vector a = vertices[edge.first];
-				Vector b = vertices[edge.second];
-				Vector edgeAxis = (b - a).idemparallel();
-				if (!discoveredEdgeAxes.count(edgeAxis)) {
-					discoveredEdgeAxes.insert(edgeAxis);
-					if (edgeAxis.unit()) edgeAxes.push_back(edgeAxis);
+				Geometry(const std::vector<Vector>& _vertices, const std::vector<IndexFace>& _faces) {
+					vertices = _vertices;
+					faces = _faces;
+					computeDependentData();
 				}
-				edges.push_back({ edge.first, edge.second });
-			}
-#else
-			edges = faces;
+		};
+
+		class CookedEntry {
+			public:
+				std::vector<Vector> vertices;
+				std::vector<IndexFace> faces;
+				std::weak_ptr<const Geometry> geometry;
+		};
+
+		static constexpr size_t MIN_SWEEP_SIZE = 64;
+
+		std::shared_ptr<const Geometry> geometry;
+		double scale = 1.0;
+
+		static std::shared_ptr<const Geometry> cook(const std::vector<Vector>& vertices, const std::vector<IndexFace>& faces) {
+			static std::unordered_multimap<size_t, CookedEntry> cooked;
+			static size_t sweepSize = MIN_SWEEP_SIZE;
+#if THREADS
+			static std::mutex mutex;
+			std::unique_lock lock (mutex);
 #endif
+
+			std::hash<Vector> vectorHash;
+			size_t key = vertices.size() * 31 + faces.size();
+			for (const Vector& vertex : vertices)
+				key = key * 1000003 ^ vectorHash(vertex);
+			for (const IndexFace& face : faces)
+				for (int index : face)
+					key = key * 31 + index;
+
+			auto [begin, end] = cooked.equal_range(key);
+			for (auto it = begin; it != end; it++) {
+				const CookedEntry& entry = it->second;
+				if (entry.vertices == vertices && entry.faces == faces)
+					if (auto geometry = entry.geometry.lock())
+						return geometry;
+			}
+
+			// forget shapes that no longer have any instances
+			if (cooked.size() > sweepSize) {
+				std::erase_if(cooked, [](const auto& item) {
+					return item.second.geometry.expired();
+				});
+				sweepSize = std::max(MIN_SWEEP_SIZE, cooked.size() * 2);
+			}
+
+			auto geometry = std::make_shared<const Geometry>(vertices, faces);
+			cooked.emplace(key, CookedEntry { vertices, faces, geometry });
+			return geometry;
+		}
+
+		Polytope(const std::shared_ptr<const Geometry>& _geometry, double _scale)
+		: Shape(POLYTOPE) {
+			geometry = _geometry;
+			scale = _scale;
+			sync(*this, { });
 		}
 
 	protected:
@@ -235,28 +345,53 @@ API class Polytope : public Shape {
 		Vector position;
 
 #if IS_3D
-		Polytope(const std::vector<Vector>& _vertices, const std::vector<IndexFace>& _faces) : Shape(POLYTOPE) {
-			vertices = _vertices;
-			faces = _faces;
-			computeDependentData();
-		}
+		Polytope(const std::vector<Vector>& _vertices, const std::vector<IndexFace>& _faces)
+		: Polytope(cook(_vertices, _faces), 1.0) { }
 
-		API Polytope(const std::vector<Vector>& _vertices, const std::vector<int>& _faces) : Shape(POLYTOPE) {
-			vertices = _vertices;
-			faces = { };
+		API Polytope(const std::vector<Vector>& _vertices, const std::vector<int>& _faces)
+		: Shape(POLYTOPE) {
+			std::vector<IndexFace> faces;
 			for (int i = 0; i < _faces.size(); i += 3)
 				faces.push_back({ _faces[i], _faces[i + 1], _faces[i + 2] });
-			computeDependentData();
+			geometry = cook(_vertices, faces);
+			sync(*this, { });
 		}
 #else
 		API Polytope(const std::vector<Vector>& _vertices) : Shape(POLYTOPE) {
-			vertices = _vertices;
-			for (int i = 0; i < vertices.size(); i++)
-				faces.push_back({ i, (int)((i + 1) % vertices.size()) });
-			computeDependentData();
+			std::vector<IndexFace> faces;
+			for (int i = 0; i < _vertices.size(); i++)
+				faces.push_back({ i, (int)((i + 1) % _vertices.size()) });
+			geometry = cook(_vertices, faces);
+			sync(*this, { });
+		}
+#endif
+
+		API static Polytope* fromHull(const std::vector<Vector>& points, int maxVertices) {
+			Hull hull = Hull::build(points, maxVertices);
+			if (hull.empty()) return nullptr;
+			return IF_3D(
+				new Polytope(hull.vertices, hull.faces),
+				new Polytope(hull.vertices)
+			);
+		}
+
+#if !IS_3D
+		API static std::vector<Polytope*> decompose(const std::vector<Vector>& vertices) {
+			std::vector<Polytope*> result;
+			for (const std::vector<Vector>& piece : Decomposition::convex(vertices))
+				result.push_back(new Polytope(piece));
+			return result;
 		}
 #endif
 
+		API Polytope* instance(double _scale) const {
+			return new Polytope(geometry, scale * _scale);
+		}
+
+		API double getScale() const {
+			return scale;
+		}
+
 		Shape* copy() const override {
 			return new Polytope(*this);
 		}
@@ -267,48 +402,54 @@ API class Polytope : public Shape {
 
 		void sync(const Shape& reference, const Transform& transf) override {
 			const Polytope& poly = (const Polytope&)reference;
+			if (geometry != poly.geometry) geometry = poly.geometry;
+			scale = poly.scale;
+
+			const Geometry& model = *geometry;
+			if (vertices.size() != model.vertices.size()) vertices = model.vertices;
+			if (edgeAxes.size() != model.edgeAxes.size()) edgeAxes = model.edgeAxes;
+			if (planes.size() != model.planes.size()) planes = model.planes;
+
 			for (int i = 0; i < vertices.size(); i++)
-				vertices[i] = transf * poly.vertices[i];
+				vertices[i] = transf * (model.vertices[i] * scale);
 			for (int i = 0; i < edgeAxes.size(); i++)
-				edgeAxes[i] = transf.orientation * poly.edgeAxes[i];
+				edgeAxes[i] = transf.orientation * model.edgeAxes[i];
 			for (int i = 0; i < planes.size(); i++) {
-				const Plane& plane = poly.planes[i];
+				const Plane& plane = model.planes[i];
 				planes[i].normal = transf.orientation * plane.normal;
-				planes[i].distance = dot(transf.linear, planes[i].normal) + plane.distance;
+				planes[i].distance = dot(transf.linear, planes[i].normal) + plane.distance * scale;
 			}
-			position = transf * poly.position;
+			position = transf * (model.position * scale);
 		}
 
 		int getFaceCount() const {
-			return faces.size();
+			return geometry->faces.size();
 		}
 
 		Face getFace(int index) const {
 			std::array<Vector, DIM> points;
 			for (int i = 0; i < points.size(); i++)
-				points[i] = vertices[faces[index][i]];
+				points[i] = vertices[geometry->faces[index][i]];
 			return points;
 		}
 
 		int getEdgeCount() const {
-			return edges.size();
+			return geometry->edges.size();
 		}
 
 		Line getEdge(int index) const {
 			return {
-				vertices[edges[index][0]],
-				vertices[edges[index][1]]
+				vertices[geometry->edges[index][0]],
+				vertices[geometry->edges[index][1]]
 			};
 		}
 
 		Matter getMatter() const override {
-			Matter result;
-
-			for (int i = 0; i < faces.size(); i++)
-				result += getComponentMatter(getFace(i));
-			
-			result.computeInverses();
-			return result;
+			const Matter& matter = geometry->matter;
+			return {
+				matter.mass * std::pow(scale, DIM),
+				matter.inertia * std::pow(scale, DIM + 2)
+			};
 		}
 
 		AABB getBounds() const override {
@@ -363,4 +504,574 @@ API class Polytope : public Shape {
 
 			return distance;
 		}
-};
\ No newline at end of file
+};
+
+#if IS_3D
+API class Heightfield : public Shape {
+	private:
+		static constexpr double THICKNESS = 10.0;
+		static constexpr int MAX_CACHED_PRISMS = 4096;
+
+		int columns, rows;
+		double cellSize;
+		std::shared_ptr<const std::vector<double>> heights;
+		double minHeight, maxHeight;
+		// one cache per thread, as collision tests write to the prisms' caches
+		mutable std::array<std::unordered_map<int, Polytope>, ThreadPool::MAX_THREADS> prisms;
+
+		double getHeight(int column, int row) const {
+			return (*heights)[row * columns + column];
+		}
+
+		Vector getLocalPoint(int column, int row) const {
+			return { column * cellSize, getHeight(column, row), row * cellSize };
+		}
+
+		Triangle getLocalTriangle(int column, int row, int half) const {
+			Vector a = getLocalPoint(column, row);
+			Vector c = getLocalPoint(column + 1, row + 1);
+			return half ?
+				Triangle(a, c, getLocalPoint(column, row + 1)) :
+				Triangle(a, getLocalPoint(column + 1, row), c);
+		}
+
+		int clampColumn(double x) const {
+			return std::clamp((int)std::floor(x / cellSize), 0, columns - 2);
+		}
+
+		int clampRow(double z) const {
+			return std::clamp((int)std::floor(z / cellSize), 0, rows - 2);
+		}
+
+		AABB getLocalBounds() const {
+			return {
+				{ 0.0, minHeight, 0.0 },
+				{ (columns - 1) * cellSize, maxHeight + THICKNESS, (rows - 1) * cellSize }
+			};
+		}
+
+		AABB toLocal(const AABB& box) const {
+			Transform inverse = transform.inverse();
+			AABB result;
+			for (int i = 0; i < 8; i++) {
+				Vector corner {
+					(i & 1 ? box.max : box.min)[0],
+					(i & 2 ? box.max : box.min)[1],
+					(i & 4 ? box.max : box.min)[2]
+				};
+				result.add(inverse * corner);
+			}
+			return result;
+		}
+
+		const Polytope& getPrism(int column, int row, int half) const {
+			int key = (row * columns + column) * 2 + half;
+			auto& cache = prisms[ThreadPool::getThreadIndex()];
+			auto cached = cache.find(key);
+			if (cached != cache.end()) return cached->second;
+
+			// extrude the surface triangle into the solid (+y) side of the field
+			Triangle triangle = getLocalTriangle(column, row, half);
+			double bottom = maxHeight + THICKNESS;
+			std::vector<Vector> vertices {
+				triangle.a, triangle.b, triangle.c,
+				{ triangle.a[0], bottom, triangle.a[2] },
+				{ triangle.b[0], bottom, triangle.b[2] },
+				{ triangle.c[0], bottom, triangle.c[2] }
+			};
+
+			std::vector<std::array<int, 3>> faces {
+				{ 0, 1, 2 }, { 3, 5, 4 },
+				{ 0, 3, 4 }, { 0, 4, 1 },
+				{ 1, 4, 5 }, { 1, 5, 2 },
+				{ 2, 5, 3 }, { 2, 3, 0 }
+			};
+
+			Vector center = average(vertices);
+			for (Vector& vertex : vertices)
+				vertex = transform * vertex;
+			center = transform * center;
+
+			// wind every face so that its plane faces inward
+			for (auto& face : faces) {
+				Triangle tri (vertices[face[0]], vertices[face[1]], vertices[face[2]]);
+				if (dot(tri.normal(), center - tri.a) < 0.0)
+					std::swap(face[1], face[2]);
+			}
+
+			return cache.emplace(key, Polytope(vertices, faces)).first->second;
+		}
+
+	protected:
+		void output(std::ostream& out) const override {
+			out << "Heightfield(" << columns << " x " << rows << ", " << cellSize << ")";
+		}
+
+	public:
+		Transform transform;
+
+		API Heightfield(int _columns, int _rows, double _cellSize, const std::vector<double>& _heights)
+		: Shape(HEIGHTFIELD) {
+			columns = std::max(_columns, 2);
+			rows = std::max(_rows, 2);
+			cellSize = _cellSize > 0.0 ? _cellSize : 1.0;
+
+			std::vector<double> grid (columns * rows, 0.0);
+			std::copy_n(_heights.begin(), std::min(_heights.size(), grid.size()), grid.begin());
+			heights = std::make_shared<const std::vector<double>>(std::move(grid));
+
+			auto [min, max] = std::minmax_element(heights->begin(), heights->end());
+			minHeight = *min;
+			maxHeight = *max;
+		}
+
+		Shape* copy() const override {
+			return new Heightfield(*this);
+		}
+
+		void clearCache() override {
+			for (auto& cache : prisms)
+				for (auto& [key, prism] : cache)
+					prism.clearCache();
+		}
+
+		void sync(const Shape& reference, const Transform& transf) override {
+			const Heightfield& field = (const Heightfield&)reference;
+			Transform next = transf * field.transform;
+			if (next == transform) return;
+			transform = next;
+			for (auto& cache : prisms)
+				cache.clear();
+		}
+
+		Matter getMatter() const override {
+			return { };
+		}
+
+		bool hasMatter() const override {
+			return false;
+		}
+
+		AABB getBounds() const override {
+			AABB local = getLocalBounds();
+			AABB result;
+			for (int i = 0; i < 8; i++) {
+				Vector corner {
+					(i & 1 ? local.max : local.min)[0],
+					(i & 2 ? local.max : local.min)[1],
+					(i & 4 ? local.max : local.min)[2]
+				};
+				result.add(transform * corner);
+			}
+			return result;
+		}
+
+		AABB getBallBounds() const override {
+			return getCornerRadius(getBounds());
+		}
+
+		std::vector<const Polytope*> getPrisms(const AABB& bounds) const {
+			std::vector<const Polytope*> result;
+			auto& cache = prisms[ThreadPool::getThreadIndex()];
+			if (cache.size() > MAX_CACHED_PRISMS) cache.clear();
+
+			AABB local = toLocal(bounds);
+			if (!local.intersects(getLocalBounds())) return result;
+
+			int minColumn = clampColumn(local.min[0]);
+			int maxColumn = clampColumn(local.max[0]);
+			int minRow = clampRow(local.min[2]);
+			int maxRow = clampRow(local.max[2]);
+
+			for (int row = minRow; row <= maxRow; row++)
+			for (int column = minColumn; column <= maxColumn; column++)
+			for (int half = 0; half < 2; half++) {
+				Triangle triangle = getLocalTriangle(column, row, half);
+				double top = std::min({ triangle.a[1], triangle.b[1], triangle.c[1] });
+				if (local.max[1] < top) continue;
+				result.push_back(&getPrism(column, row, half));
+			}
+
+			return result;
+		}
+
+		double raycast(const Ray& ray) const override {
+			Transform inverse = transform.inverse();
+			Ray local (inverse * ray.origin, inverse.orientation * ray.direction);
+			Vector origin = local.origin;
+			Vector direction = local.direction;
+
+			// clip the ray against the horizontal extent of the grid
+			AABB extent = getLocalBounds();
+			double enter = 0.0;
+			double exit = INFINITY;
+			for (int axis : { 0, 2 }) {
+				if (equals(direction[axis], 0.0)) {
+					if (!Shadow(extent.min[axis], extent.max[axis]).contains(origin[axis]))
+						return -1;
+					continue;
+				}
+
+				double a = (extent.min[axis] - origin[axis]) / direction[axis];
+				double b = (extent.max[axis] - origin[axis]) / direction[axis];
+				enter = std::max(enter, std::min(a, b));
+				exit = std::min(exit, std::max(a, b));
+			}
+
+			if (enter > exit) return -1;
+
+			// walk the cells under the ray with a 2D DDA
+			Vector start = local.atDistance(enter);
+			int cell[] { clampColumn(start[0]), clampRow(start[2]) };
+			int limit[] { columns - 1, rows - 1 };
+			int step[2];
+			double next[2], delta[2];
+
+			for (int i = 0; i < 2; i++) {
+				double dir = direction[i * 2];
+				if (equals(dir, 0.0)) {
+					step[i] = 0;
+					next[i] = delta[i] = INFINITY;
+					continue;
+				}
+
+				step[i] = dir > 0.0 ? 1 : -1;
+				double boundary = (cell[i] + (dir > 0.0)) * cellSize;
+				next[i] = (boundary - origin[i * 2]) / dir;
+				delta[i] = cellSize / std::abs(dir);
+			}
+
+			while (cell[0] >= 0 && cell[0] < limit[0] && cell[1] >= 0 && cell[1] < limit[1]) {
+				double best = -1;
+				for (int half = 0; half < 2; half++) {
+					double dist = getLocalTriangle(cell[0], cell[1], half).raycast(local);
+					if (dist > 0 && (best < 0 || dist < best))
+						best = dist;
+				}
+
+				if (best > 0) return best;
+
+				int axis = next[0] < next[1] ? 0 : 1;
+				if (next[axis] > exit) break;
+				cell[axis] += step[axis];
+				next[axis] += delta[axis];
+			}
+
+			return -1;
+		}
+};
+#endif
+
+#if !IS_3D
+API class Tilemap : public Shape {
+	private:
+		static constexpr int WORD_BITS = 32;
+		static constexpr int MAX_CACHED_RECTANGLES = 4096;
+
+		// the tiles and the rectangles merged from them, shared by every copy of the map so that edits reach
+		// the copies the engine collides with. the rectangles are merged again once the engine takes the edits,
+		// or the first time they're needed after one outside the engine
+		struct Grid {
+			std::vector<uint32_t> tiles;
+			std::vector<std::array<int, 4>> rectangles;
+			// for each tile, the rectangles covering it that were merged along its row and along its column
+			std::vector<std::array<int, 2>> covers;
+			int version = 0;
+			int merged = -1;
+		};
+
+		int columns, rows;
+		double tileSize;
+		std::shared_ptr<Grid> grid;
+		// the tiles set or cleared since the engine last looked, in the map's own space
+		AABB edits;
+		// one cache per thread, as collision tests write to the rectangles' caches
+		mutable std::array<std::unordered_map<int, Polytope>, ThreadPool::MAX_THREADS> rectangles;
+		mutable std::array<int, ThreadPool::MAX_THREADS> cachedVersions { };
+
+		bool inBounds(int column, int row) const {
+			return column >= 0 && column < columns && row >= 0 && row < rows;
+		}
+
+		AABB getLocalBounds() const {
+			return { { 0.0, 0.0 }, { columns * tileSize, rows * tileSize } };
+		}
+
+		AABB transformBounds(const AABB& box, const Transform& transf) const {
+			AABB result;
+			for (int i = 0; i < 4; i++)
+				result.add(transf * Vector(
+					(i & 1 ? box.max : box.min)[0],
+					(i & 2 ? box.max : box.min)[1]
+				));
+			return result;
+		}
+
+		// merges runs of solid tiles along each row, then stacks identical runs across rows. this is done along
+		// columns as well, so that every straight stretch of surface is a single face of some rectangle
+		void merge() const {
+			Grid& merging = *grid;
+			merging.rectangles.clear();
+			merging.covers.assign(columns * rows, { -1, -1 });
+
+			using Run = std::pair<int, int>;
+			auto sweep = [&](bool alongColumns) {
+				int lines = alongColumns ? columns : rows;
+				int cells = alongColumns ? rows : columns;
+				auto solid = [&](int line, int cell) {
+					return alongColumns ? getTile(line, cell) : getTile(cell, line);
+				};
+				auto flush = [&](const Run& run, int startLine, int endLine) {
+					std::array<int, 4> rectangle = alongColumns ?
+						std::array { startLine, run.first, endLine, run.second } :
+						std::array { run.first, startLine, run.second, endLine };
+					// each sweep covers every solid tile once, so the only rectangle the other sweep
+					// might have found already is the one covering the same corner
+					int index = merging.covers[rectangle[1] * columns + rectangle[0]][0];
+					if (!alongColumns || index < 0 || merging.rectangles[index] != rectangle) {
+						index = merging.rectangles.size();
+						merging.rectangles.push_back(rectangle);
+					}
+					for (int row = rectangle[1]; row <= rectangle[3]; row++)
+					for (int column = rectangle[0]; column <= rectangle[2]; column++)
+						merging.covers[row * columns + column][alongColumns] = index;
+				};
+
+				std::unordered_map<Run, int> open, next;
+				for (int line = 0; line < lines; line++) {
+					next.clear();
+					for (int cell = 0; cell < cells; cell++) {
+						if (!solid(line, cell)) continue;
+						int start = cell;
+						while (cell < cells - 1 && solid(line, cell + 1)) cell++;
+						Run run { start, cell };
+						auto prev = open.find(run);
+						next.emplace(run, prev == open.end() ? line : prev->second);
+					}
+
+					for (const auto& [run, startLine] : open)
+						if (!next.count(run)) flush(run, startLine, line - 1);
+
+					std::swap(open, next);
+				}
+
+				for (const auto& [run, startLine] : open)
+					flush(run, startLine, lines - 1);
+			};
+
+			sweep(false);
+			sweep(true);
+			merging.merged = merging.version;
+		}
+
+		const Polytope& getRectangle(int index) const {
+			auto& cache = rectangles[ThreadPool::getThreadIndex()];
+			auto cached = cache.find(index);
+			if (cached != cache.end()) return cached->second;
+
+			const auto& [minColumn, minRow, maxColumn, maxRow] = grid->rectangles[index];
+			double x0 = minColumn * tileSize;
+			double y0 = minRow * tileSize;
+			double x1 = (maxColumn + 1) * tileSize;
+			double y1 = (maxRow + 1) * tileSize;
+			return cache.emplace(index, Polytope({
+				transform * Vector(x0, y0),
+				transform * Vector(x1, y0),
+				transform * Vector(x1, y1),
+				transform * Vector(x0, y1)
+			})).first->second;
+		}
+
+	protected:
+		void output(std::ostream& out) const override {
+			out << "Tilemap(" << columns << " x " << rows << ", " << tileSize << ")";
+		}
+
+	public:
+		Transform transform;
+
+		API Tilemap(int _columns, int _rows, double _tileSize, const std::vector<int>& _tiles)
+		: Shape(TILEMAP) {
+			columns = std::max(_columns, 1);
+			rows = std::max(_rows, 1);
+			tileSize = _tileSize > 0.0 ? _tileSize : 1.0;
+
+			int words = (columns * rows + WORD_BITS - 1) / WORD_BITS;
+			grid = std::make_shared<Grid>();
+			grid->tiles.resize(words, 0);
+			for (int i = 0; i < std::min(words, (int)_tiles.size()); i++)
+				grid->tiles[i] = _tiles[i];
+			merge();
+		}
+
+		API bool getTile(int column, int row) const {
+			if (!inBounds(column, row)) return false;
+			int index = row * columns + column;
+			return grid->tiles[index / WORD_BITS] >> (index % WORD_BITS) & 1;
+		}
+
+		API void setTile(int column, int row, bool solid) {
+			if (!inBounds(column, row)) return;
+			int index = row * columns + column;
+			uint32_t mask = 1u << (index % WORD_BITS);
+			if (getTile(column, row) == solid) return;
+			grid->tiles[index / WORD_BITS] ^= mask;
+			grid->version++;
+			edits.add(AABB(Vector(column, row) * tileSize, Vector(column + 1, row + 1) * tileSize));
+		}
+
+		Shape* copy() const override {
+			return new Tilemap(*this);
+		}
+
+		void clearCache() override {
+			for (auto& cache : rectangles)
+				for (auto& [index, rectangle] : cache)
+					rectangle.clearCache();
+		}
+
+		// merged here, where the engine isn't yet testing collisions on several threads
+		std::optional<AABB> takeEdits(const Transform& transf) override {
+			if (!edits.intersects(edits)) return std::nullopt;
+			merge();
+			AABB result = transformBounds(edits, transf * transform);
+			edits = { };
+			return result;
+		}
+
+		void sync(const Shape& reference, const Transform& transf) override {
+			const Tilemap& map = (const Tilemap&)reference;
+			Transform next = transf * map.transform;
+			if (next == transform) return;
+			transform = next;
+			for (auto& cache : rectangles)
+				cache.clear();
+		}
+
+		Matter getMatter() const override {
+			return { };
+		}
+
+		bool hasMatter() const override {
+			return false;
+		}
+
+		AABB getBounds() const override {
+			return transformBounds(getLocalBounds(), transform);
+		}
+
+		AABB getBallBounds() const override {
+			return getCornerRadius(getBounds());
+		}
+
+		// whether a rectangle face with the outward normal lies against another solid tile at the point. such
+		// faces are seams between rectangles rather than part of the surface, and would snag bodies sliding past
+		bool isSeam(const Vector& point, const Vector& normal) const {
+			Transform inverse = transform.inverse();
+			Vector localNormal = inverse.orientation * normal;
+			int axis = std::abs(localNormal[0]) > std::abs(localNormal[1]) ? 0 : 1;
+			if (!equals(std::abs(localNormal[axis]), 1.0)) return false;
+
+			Vector across = inverse * point + localNormal * (tileSize * 0.5);
+			return getTile(std::floor(across[0] / tileSize), std::floor(across[1] / tileSize));
+		}
+
+		// the merged rectangles covering any tile the bounds overlap
+		std::vector<const Polytope*> getRectangles(const AABB& bounds) const {
+			std::vector<const Polytope*> result;
+			if (grid->merged != grid->version) merge();
+
+			int thread = ThreadPool::getThreadIndex();
+			auto& cache = rectangles[thread];
+			if (cachedVersions[thread] != grid->version || cache.size() > MAX_CACHED_RECTANGLES) {
+				cachedVersions[thread] = grid->version;
+				cache.clear();
+			}
+
+			AABB local = transformBounds(bounds, transform.inverse());
+			if (!local.intersects(getLocalBounds())) return result;
+
+			int minColumn = std::max((int)std::floor(local.min[0] / tileSize), 0);
+			int maxColumn = std::min((int)std::floor(local.max[0] / tileSize), columns - 1);
+			int minRow = std::max((int)std::floor(local.min[1] / tileSize), 0);
+			int maxRow = std::min((int)std::floor(local.max[1] / tileSize), rows - 1);
+
+			std::vector<int> indices;
+			for (int row = minRow; row <= maxRow; row++)
+			for (int column = minColumn; column <= maxColumn; column++)
+				for (int index : grid->covers[row * columns + column])
+					if (index >= 0) indices.push_back(index);
+
+			std::sort(indices.begin(), indices.end());
+			indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+			for (int index : indices)
+				result.push_back(&getRectangle(index));
+
+			return result;
+		}
+
+		double raycast(const Ray& ray) const override {
+			Transform inverse = transform.inverse();
+			Ray local (inverse * ray.origin, inverse.orientation * ray.direction);
+			Vector origin = local.origin;
+			Vector direction = local.direction;
+
+			// clip the ray against the grid
+			AABB extent = getLocalBounds();
+			double enter = 0.0;
+			double exit = INFINITY;
+			for (int axis = 0; axis < 2; axis++) {
+				if (equals(direction[axis], 0.0)) {
+					if (!Shadow(extent.min[axis], extent.max[axis]).contains(origin[axis]))
+						return -1;
+					continue;
+				}
+
+				double a = (extent.min[axis] - origin[axis]) / direction[axis];
+				double b = (extent.max[axis] - origin[axis]) / direction[axis];
+				enter = std::max(enter, std::min(a, b));
+				exit = std::min(exit, std::max(a, b));
+			}
+
+			if (enter > exit) return -1;
+
+			// walk the tiles under the ray with a DDA, reporting the first solid tile entered
+			Vector start = local.atDistance(enter);
+			int cell[] {
+				std::clamp((int)std::floor(start[0] / tileSize), 0, columns - 1),
+				std::clamp((int)std::floor(start[1] / tileSize), 0, rows - 1)
+			};
+			int step[2];
+			double next[2], delta[2];
+
+			for (int i = 0; i < 2; i++) {
+				double dir = direction[i];
+				if (equals(dir, 0.0)) {
+					step[i] = 0;
+					next[i] = delta[i] = INFINITY;
+					continue;
+				}
+
+				step[i] = dir > 0.0 ? 1 : -1;
+				double boundary = (cell[i] + (dir > 0.0)) * tileSize;
+				next[i] = (boundary - origin[i]) / dir;
+				delta[i] = tileSize / std::abs(dir);
+			}
+
+			double t = enter;
+			bool wasEmpty = enter > 0.0 || !getTile(cell[0], cell[1]);
+			while (inBounds(cell[0], cell[1]) && t <= exit) {
+				bool solid = getTile(cell[0], cell[1]);
+				if (solid && wasEmpty && t > 0.0) return t;
+				wasEmpty = !solid;
+
+				int axis = next[0] < next[1] ? 0 : 1;
+				t = next[axis];
+				cell[axis] += step[axis];
+				next[axis] += delta[axis];
+			}
+
+			return -1;
+		}
+};
+#endif
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+#include <cinttypes>
+
+#include "RigidBody.hpp"
+
+// the state that velocity iterations touch, packed into contiguous arrays addressed by 32-bit index.
+// bodies are gathered before the iterations and scattered back after, so the solver doesn't chase RigidBody pointers
+class SolverBodies {
+	public:
+		static constexpr uint32_t NONE = UINT32_MAX;
+
+		std::vector<RigidBody*> bodies;
+		std::vector<Vector> linear;
+		std::vector<Rotation> angular;
+		std::vector<double> invMass;
+		std::vector<Inertia> invInertia;
+
+		void clear() {
+			bodies.clear();
+			linear.clear();
+			angular.clear();
+			invMass.clear();
+			invInertia.clear();
+		}
+
+		// the body's solverIndex must have been reset to NONE since the last gather
+		uint32_t add(RigidBody& body) {
+			if (body.solverIndex != NONE) return body.solverIndex;
+
+			body.solverIndex = bodies.size();
+			bodies.push_back(&body);
+			linear.push_back(body.velocity.linear);
+			angular.push_back(body.velocity.orientation.getRotation());
+			invMass.push_back(body.matter.invMass);
+			invInertia.push_back(body.canRotate ? body.matter.invInertia : body.matter.invInertia * 0.0);
+			return body.solverIndex;
+		}
+
+		void scatter() {
+			for (uint32_t i = 0; i < bodies.size(); i++) {
+				RigidBody& body = *bodies[i];
+				body.velocity.linear = linear[i];
+				body.velocity.orientation = Orientation(angular[i]);
+			}
+		}
+
+		Vector getPointVelocity(uint32_t index, const Vector& offset) const {
+			return linear[index] + IF_3D(
+				cross(angular[index], offset),
+				offset.normal() * angular[index]
+			);
+		}
+
+		void applyImpulse(uint32_t index, const Vector& offset, const Vector& impulse) {
+			applyImpulseAndTorque(index, impulse, cross(offset, impulse));
+		}
+
+		void applyImpulseAndTorque(uint32_t index, const Vector& impulse, const Cross& torque) {
+			linear[index] += invMass[index] * impulse;
+			angular[index] += invInertia[index] * torque;
+		}
+};
@@ -11,27 +11,68 @@
 class SpatialHash {
 	private:
 		static constexpr int CELLS_PER_ITEM = raiseTo(2, DIM);
-		std::unordered_map<Coord, std::vector<RigidBody::Collider*>> cells;
+		static constexpr int MAX_CELLS_PER_ITEM = raiseTo(8, DIM);
+		std::unordered_map<Coord, std::vector<RigidBody*>> cells;
+		std::vector<RigidBody*> large;
+		// the cells each kinematic body was filed under, so that it can be moved without a rebuild
+		std::unordered_map<RigidBody*, std::pair<Coord, Coord>> filed;
 		double cellSize;
 		double dt;
 		size_t wave;
 
-		AABB boundsOf(const RigidBody::Collider& collider) const {
-			RigidBody* body = collider.body;
-			return collider.localBounds + (body->position.linear + body->velocity.linear * dt);
+		static bool canCollide(const RigidBody& a, const RigidBody& b) {
+			if (&a == &b) return false;
+			return a.canCollideWith(b) && b.canCollideWith(a);
 		}
-		
-		static bool canCollide(const RigidBody::Collider& a, const RigidBody::Collider& b) {
-			if (a.body == b.body) return false;
-			return a.body->canCollideWith(*b.body) && b.body->canCollideWith(*a.body);
+
+		// everything that overlaps the bounds and passes the filter, each only once
+		template <std::predicate<const RigidBody&> F>
+		void query(const AABB& bounds, std::vector<RigidBody*>& result, const F& filter) {
+			if (cells.empty() && large.empty()) return;
+
+			wave++;
+			
+			for (RigidBody* contained : large)
+				if (filter(*contained) && boundsOf(*contained).intersects(bounds))
+					result.push_back(contained);
+
+			if (cells.empty()) return;
+
+			Coord min (bounds.min / cellSize);
+			Coord max (bounds.max / cellSize);
+			ND_LOOP(cell, min, max) {
+				for (RigidBody* contained : cells[cell]) {
+					if (contained->wave < wave) {
+						contained->wave = wave;
+						if (filter(*contained))
+							result.push_back(contained);
+					}
+				}
+			}
 		}
 
 	public:
 		SpatialHash() { }
 
+		// everything a body passes through over the step, since contacts are looked for at every substep and a body
+		// stopped early by one thing is still in the path of the next. kinematic bodies are already where they'll be
+		// for the step, their velocity only being how they got there
+		AABB boundsOf(const RigidBody& body) const {
+			AABB bounds = body.localBounds + body.position.linear;
+			if (!body.getKinematic()) bounds.add(bounds + body.velocity.linear * dt);
+			return bounds;
+		}
+
+		// whether two bodies found by a query could actually meet this step, since cells only narrow it down
+		bool overlaps(const RigidBody& a, const RigidBody& b) const {
+			return boundsOf(a).intersects(boundsOf(b));
+		}
+
 		void build(const std::vector<RigidBody*>& container, double _dt) {
 			dt = _dt;
 			cells.clear();
+			large.clear();
+			filed.clear();
 			wave = 0;
 
 			if (container.empty()) return;
@@ -41,44 +82,64 @@ class SpatialHash {
 			for (RigidBody* body : container) {
 				double volume = body->localMatter.mass / body->getDensity();
 				if (!isnan(volume)) total += volume;
-				itemCount += body->colliders.size();
+				if (!body->colliders.empty()) itemCount++;
 			}
 
 			if (!itemCount) return;
 
 			cellSize = std::pow(total / (itemCount * CELLS_PER_ITEM), 1.0 / DIM);
+			if (!(cellSize > 0.0)) cellSize = 1.0;
 			
+			// each body is a single entry, its colliders are sorted out by the mid-phase
 			for (RigidBody* body : container) {
-				if (!body->canCollide) continue;
+				if (!body->canCollide || body->colliders.empty()) continue;
 	
-				for (RigidBody::Collider& collider : body->colliders) {
-					collider.wave = 0;
-					AABB bounds = boundsOf(collider);
-					Coord min (bounds.min / cellSize);
-					Coord max (bounds.max / cellSize);
-					ND_LOOP(cell, min, max) {
-						cells[cell].push_back(&collider);
-					}
+				body->wave = 0;
+				AABB bounds = boundsOf(*body);
+				Coord min (bounds.min / cellSize);
+				Coord max (bounds.max / cellSize);
+
+				// huge bodies (e.g. terrain) are checked directly rather than spread over cells
+				double cellCount = 1;
+				for (int i = 0; i < DIM; i++)
+					cellCount *= max[i] - min[i] + 1.0;
+				if (cellCount > MAX_CELLS_PER_ITEM) {
+					large.push_back(body);
+					continue;
+				}
+
+				ND_LOOP(cell, min, max) {
+					cells[cell].push_back(body);
 				}
+				if (body->getKinematic()) filed[body] = { min, max };
 			}
 		}
 
-		void query(const RigidBody::Collider& collider, std::vector<RigidBody::Collider*>& result) {
-			if (cells.empty()) return;
+		// refiles a kinematic body that has moved since the build, touching only the cells it was and now is in
+		void move(RigidBody& body) {
+			auto found = filed.find(&body);
+			if (found == filed.end()) return;
 
-			wave++;
-			
-			AABB bounds = boundsOf(collider);
+			AABB bounds = boundsOf(body);
 			Coord min (bounds.min / cellSize);
 			Coord max (bounds.max / cellSize);
+			auto& [lastMin, lastMax] = found->second;
+			if (min == lastMin && max == lastMax) return;
+
+			ND_LOOP(cell, lastMin, lastMax) {
+				erase(cells[cell], &body);
+			}
 			ND_LOOP(cell, min, max) {
-				for (RigidBody::Collider* contained : cells[cell]) {
-					if (contained->wave < wave) {
-						contained->wave = wave;
-						if (canCollide(collider, *contained))
-							result.push_back(contained);
-					}
-				}
+				cells[cell].push_back(&body);
 			}
+			found->second = { min, max };
+		}
+
+		void query(const RigidBody& body, std::vector<RigidBody*>& result) {
+			query(boundsOf(body), result, [&](const RigidBody& other) { return canCollide(body, other); });
+		}
+
+		void query(const AABB& bounds, std::vector<RigidBody*>& result) {
+			query(bounds, result, [](const RigidBody&) { return true; });
 		}
 };
\ No newline at end of file
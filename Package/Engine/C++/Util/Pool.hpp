@@ -0,0 +1,33 @@
+#pragma once
+
+#include <deque>
+#include <optional>
+#include <utility>
+
+// stable storage for objects that are made and dropped in bulk, such as a step's constraints.
+// slots are handed out in order and given back from a mark onwards, so marks may nest,
+// and the same memory is reused from step to step instead of going through the heap
+template <typename T>
+class Pool {
+	private:
+		std::deque<std::optional<T>> slots;
+		int used = 0;
+
+	public:
+		template <typename... Args>
+		T* make(Args&&... args) {
+			if (used == slots.size()) slots.emplace_back();
+			return &slots[used++].emplace(std::forward<Args>(args)...);
+		}
+
+		int mark() const {
+			return used;
+		}
+
+		// drops everything made since the mark was taken
+		void release(int mark) {
+			for (int i = mark; i < used; i++)
+				slots[i].reset();
+			used = mark;
+		}
+};
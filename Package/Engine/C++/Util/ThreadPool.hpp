@@ -0,0 +1,165 @@
+#pragma once
+
+#include <algorithm>
+
+#if THREADS
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <condition_variable>
+#endif
+
+// work-stealing pool used by native builds with THREADS. the Wasm build is single threaded,
+// so there (and without THREADS) every loop simply runs inline on the calling thread.
+// each thread keeps its own task queue, taking its newest task first and stealing
+// the oldest task of another queue when it runs dry, so loops may nest freely
+class ThreadPool {
+	public:
+#if THREADS
+		static constexpr int MAX_THREADS = 64;
+#else
+		static constexpr int MAX_THREADS = 1;
+#endif
+
+	private:
+#if THREADS
+		class Task {
+			public:
+				const void* context;
+				void (*invoke)(const void*, int);
+				int begin, end;
+				std::atomic<int>* pending;
+		};
+
+		class Queue {
+			public:
+				std::mutex mutex;
+				std::deque<Task> tasks;
+		};
+
+		static inline thread_local int current = 0;
+
+		std::vector<std::thread> workers;
+		std::unique_ptr<Queue[]> queues;
+		int threadCount = 1;
+		std::mutex sleepMutex;
+		std::condition_variable wake;
+		std::atomic<int> queued = 0;
+		std::atomic<bool> stopping = false;
+
+		void start() {
+			threadCount = std::clamp((int)std::thread::hardware_concurrency(), 1, MAX_THREADS);
+			queues = std::make_unique<Queue[]>(threadCount);
+			for (int i = 1; i < threadCount; i++)
+				workers.emplace_back([this, i] { work(i); });
+		}
+
+		bool pop(Task& task) {
+			Queue& queue = queues[current];
+			std::unique_lock lock (queue.mutex);
+			if (queue.tasks.empty()) return false;
+			task = queue.tasks.back();
+			queue.tasks.pop_back();
+			queued--;
+			return true;
+		}
+
+		bool steal(Task& task) {
+			for (int i = 1; i < threadCount; i++) {
+				Queue& queue = queues[(current + i) % threadCount];
+				std::unique_lock lock (queue.mutex);
+				if (queue.tasks.empty()) continue;
+				task = queue.tasks.front();
+				queue.tasks.pop_front();
+				queued--;
+				return true;
+			}
+			return false;
+		}
+
+		bool runNext() {
+			Task task;
+			if (!pop(task) && !steal(task)) return false;
+
+			for (int i = task.begin; i < task.end; i++)
+				task.invoke(task.context, i);
+			task.pending->fetch_sub(1, std::memory_order_release);
+			return true;
+		}
+
+		void work(int index) {
+			current = index;
+			while (!stopping) {
+				if (runNext()) continue;
+
+				std::unique_lock lock (sleepMutex);
+				wake.wait(lock, [&] { return stopping || queued > 0; });
+			}
+		}
+#endif
+
+	public:
+		ThreadPool() { }
+
+#if THREADS
+		~ThreadPool() {
+			{
+				std::unique_lock lock (sleepMutex);
+				stopping = true;
+			}
+			wake.notify_all();
+			for (std::thread& worker : workers)
+				worker.join();
+		}
+#endif
+
+		// slot of the calling thread, for per-thread scratch data
+		static int getThreadIndex() {
+#if THREADS
+			return current;
+#else
+			return 0;
+#endif
+		}
+
+		// calls body(i) for every i in [0, count), in no particular order, and returns once all are done.
+		// indices are handed out in runs of grain, and nothing is shared out unless there is more than one run
+		template <typename F>
+		void forEach(int count, const F& body, int grain = 1) {
+#if THREADS
+			if (count > grain) {
+				if (!queues) start();
+
+				if (threadCount > 1) {
+					int chunks = (count + grain - 1) / grain;
+					std::atomic<int> pending = chunks;
+					auto invoke = [](const void* context, int i) { (*(const F*)context)(i); };
+
+					{
+						Queue& queue = queues[current];
+						std::unique_lock lock (queue.mutex);
+						for (int i = 0; i < chunks; i++)
+							queue.tasks.push_back({ &body, invoke, i * grain, std::min(count, (i + 1) * grain), &pending });
+						queued += chunks;
+					}
+
+					{
+						std::unique_lock lock (sleepMutex);
+					}
+					wake.notify_all();
+
+					// help out until every chunk has finished, wherever it ended up
+					while (pending.load(std::memory_order_acquire) > 0)
+						if (!runNext()) std::this_thread::yield();
+					return;
+				}
+			}
+#endif
+
+			for (int i = 0; i < count; i++)
+				body(i);
+		}
+} threadPool;